@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+#include <fakeMotorDevice.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+
+/**********************************************************/
+void report(const string &name, vector<double> &lat)
+{
+    cout<<setw(22)<<left<<name<<right;
+    if (lat.empty())
+    {
+        cout<<setw(10)<<"n/a"<<endl;
+        return;
+    }
+
+    sort(lat.begin(),lat.end());
+    double p[]={0.5,0.9,0.99,0.999};
+
+    for (size_t i=0; i<sizeof(p)/sizeof(p[0]); i++)
+        cout<<setw(10)<<fixed<<setprecision(1)<<lat[(size_t)(p[i]*(lat.size()-1))];
+    cout<<setw(10)<<lat.back()<<setw(10)<<lat.size()<<endl;
+}
+
+/**
+ * Measure the latency between the stamp of the state attached
+ * by the server and the time the client gets it, the server
+ * and the client sharing the same clock within this process.
+ */
+void benchmark(const string &carrier, ResourceFinder &rf)
+{
+    string wire=rf.check("wire",Value("binary")).asString().c_str();
+    double duration=rf.check("duration",Value(5.0)).asDouble();
+    double pause=rf.check("pause",Value(0.00005)).asDouble();
+
+    Property options;
+    options.put("device","fakeyClient");
+    options.put("remote","/benchEncoderStream/server");
+    options.put("local",("/benchEncoderStream/"+carrier).c_str());
+    options.put("carrier",carrier.c_str());
+    options.put("wire",wire.c_str());
+
+    PolyDriver driver;
+    IEncodersTimed *ienc;
+    IVelocityControl *ivel;
+    int axes;
+
+    if (!driver.open(options) || !driver.view(ienc) || !driver.view(ivel) ||
+        !ienc->getAxes(&axes))
+    {
+        vector<double> none;
+        report(carrier,none);
+        return;
+    }
+
+    // keep the joints moving
+    vector<double> sp(axes,1.0);
+    ivel->velocityMove(&sp[0]);
+
+    vector<double> encs(axes),stamps(axes);
+    vector<double> lat; lat.reserve((size_t)(duration/std::max(pause,1e-6)));
+    double last=-1.0;
+
+    for (double t0=Time::now(); Time::now()-t0<duration; )
+    {
+        if (ienc->getEncodersTimed(&encs[0],&stamps[0]) && (stamps[0]!=last))
+        {
+            // latency in [us]
+            lat.push_back(1e6*(Time::now()-stamps[0]));
+            last=stamps[0];
+        }
+
+        if (pause>0.0)
+            Time::delay(pause);
+    }
+
+    ivel->stop();
+    driver.close();
+
+    report(carrier,lat);
+}
+
+
+/**********************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+    registerFakeMotorDevices();
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help"))
+    {
+        cout<<"Options:"<<endl;
+        cout<<"\t--axes     <int>    number of axes (default: 16)"<<endl;
+        cout<<"\t--period   <int>    server period in [ms] (default: 1)"<<endl;
+        cout<<"\t--duration <double> duration of each run in [s] (default: 5.0)"<<endl;
+        cout<<"\t--pause    <double> client pause between reads in [s] (default: 0.00005)"<<endl;
+        cout<<"\t--wire     <string> streaming format: binary, binary32, bottle (default: binary)"<<endl;
+        cout<<"\t--carriers <list>   carriers to compare (default: (udp tcp shmem inproc))"<<endl;
+        return 0;
+    }
+
+    if (!yarp.checkNetwork())
+    {
+        cout<<"Error: yarp server does not seem available"<<endl;
+        return 1;
+    }
+
+    int axes=rf.check("axes",Value(16)).asInt();
+    int period=rf.check("period",Value(1)).asInt();
+
+    // the server hosts a part of unbounded joints
+    ostringstream part;
+    part<<"(numAxes "<<axes<<")";
+    for (int i=0; i<axes; i++)
+        part<<" (axis_"<<i<<" (min -1e9) (max 1e9))";
+
+    Property options(part.str().c_str());
+    options.put("device","fakeyServer");
+    options.put("local","/benchEncoderStream/server");
+    options.put("Ts",period);
+
+    PolyDriver server;
+    if (!server.open(options))
+    {
+        cout<<"Error: unable to open the server"<<endl;
+        return 1;
+    }
+
+    Bottle carriers;
+    if (Bottle *list=rf.find("carriers").asList())
+        carriers=*list;
+    else
+        carriers.fromString("udp tcp shmem inproc");
+
+    cout<<"latencies in [us]"<<endl;
+    cout<<setw(22)<<left<<"carrier"<<right
+        <<setw(10)<<"p50"<<setw(10)<<"p90"<<setw(10)<<"p99"
+        <<setw(10)<<"p99.9"<<setw(10)<<"max"<<setw(10)<<"samples"<<endl;
+
+    for (int i=0; i<carriers.size(); i++)
+        benchmark(carriers.get(i).asString().c_str(),rf);
+
+    server.close();
+    return 0;
+}
+
+
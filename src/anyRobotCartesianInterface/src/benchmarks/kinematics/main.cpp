@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <iCub/iKin/iKinFwd.h>
+#include <compiledKinematics.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <chrono>
+#include <math.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace iCub::iKin;
+
+/**
+ * Time the given operation in [ns] per call.
+ */
+template<class F>
+double timeit(F op, const size_t calls)
+{
+    chrono::steady_clock::time_point t0=chrono::steady_clock::now();
+    for (size_t i=0; i<calls; i++)
+        op(i);
+    chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+    return (double)chrono::duration_cast<chrono::nanoseconds>(t1-t0).count()/calls;
+}
+
+/**********************************************************/
+void report(const string &name, const double generic, const double compiled)
+{
+    cout<<setw(12)<<left<<name<<right<<fixed<<setprecision(1)
+        <<setw(12)<<generic<<setw(12)<<compiled<<setw(10)<<generic/compiled<<endl;
+}
+
+/**********************************************************/
+int main(int argc, char *argv[])
+{
+    using namespace compiledKinematics;
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help"))
+    {
+        cout<<"Options:"<<endl;
+        cout<<"\t--calls   <int> number of calls per run (default: 100000)"<<endl;
+        cout<<"\t--samples <int> number of random configurations (default: 1000)"<<endl;
+        cout<<"\t--tol  <double> max discrepancy allowed between the paths (default: 1e-9)"<<endl;
+        return 0;
+    }
+
+    size_t calls=(size_t)rf.check("calls",Value(100000)).asInt();
+    size_t samples=(size_t)rf.check("samples",Value(1000)).asInt();
+    double tol=rf.check("tol",Value(1e-9)).asDouble();
+
+    // the generic chain is built out of the very same parameters
+    deque<iKinLink> links;
+    iKinChain chain;
+    for (unsigned int i=0; i<N; i++)
+    {
+        links.push_back(iKinLink(A[i],D[i],alpha[i],offset[i],qmin[i],qmax[i]));
+        chain<<links.back();
+    }
+
+    Matrix H0m(4,4),HNm(4,4);
+    for (int r=0; r<4; r++)
+    {
+        for (int c=0; c<4; c++)
+        {
+            H0m(r,c)=H0[4*r+c];
+            HNm(r,c)=HN[4*r+c];
+        }
+    }
+    chain.setH0(H0m);
+    chain.setHN(HNm);
+
+    // the random configurations
+    mt19937 gen(0);
+    uniform_real_distribution<double> u(0.0,1.0);
+    vector<Vector> qv(samples,Vector(N));
+    vector<double> qa(samples*N);
+    for (size_t k=0; k<samples; k++)
+    {
+        for (unsigned int i=0; i<N; i++)
+        {
+            qv[k][i]=qmin[i]+(qmax[i]-qmin[i])*u(gen);
+            qa[k*N+i]=qv[k][i];
+        }
+    }
+
+    // the two paths shall agree
+    double H[16],J[6*N];
+    double err=0.0;
+    for (size_t k=0; k<samples; k++)
+    {
+        Matrix Hg=chain.getH(qv[k]);
+        Matrix Jg=chain.GeoJacobian();
+        jacobian(&qa[k*N],J,H);
+        for (int r=0; r<4; r++)
+            for (int c=0; c<4; c++)
+                err=std::max(err,fabs(Hg(r,c)-H[4*r+c]));
+        for (int r=0; r<6; r++)
+            for (unsigned int c=0; c<N; c++)
+                err=std::max(err,fabs(Jg(r,c)-J[r*N+c]));
+    }
+
+    cout<<"chain of "<<N<<" links, max discrepancy "<<scientific<<err<<endl;
+    if (!(err<=tol))
+    {
+        cout<<"Error: the compiled kinematics departs from iKinChain by more than "<<tol<<endl;
+        return 1;
+    }
+
+    cout<<"time per call in [ns]"<<endl;
+    cout<<setw(12)<<left<<"call"<<right
+        <<setw(12)<<"iKinChain"<<setw(12)<<"compiled"<<setw(10)<<"speedup"<<endl;
+
+    double sink=0.0;
+    double tg=timeit([&](size_t i) { sink+=chain.getH(qv[i%samples])(0,3); },calls);
+    double tc=timeit([&](size_t i) { forward(&qa[(i%samples)*N],H); sink+=H[3]; },calls);
+    report("forward",tg,tc);
+
+    tg=timeit([&](size_t i) { chain.setAng(qv[i%samples]); sink+=chain.GeoJacobian()(0,0); },calls);
+    tc=timeit([&](size_t i) { jacobian(&qa[(i%samples)*N],J,H); sink+=J[0]; },calls);
+    report("jacobian",tg,tc);
+
+    // prevent the calls from being optimized away
+    return (sink==0.12345)?1:0;
+}
+
+
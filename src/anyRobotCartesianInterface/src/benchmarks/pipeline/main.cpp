@@ -0,0 +1,595 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+#include <yarp/sig/all.h>
+#include <yarp/math/Math.h>
+#include <yarp/math/Rand.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+
+#ifndef _WIN32
+    #include <unistd.h>
+    #include <signal.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <sys/time.h>
+    #include <sys/resource.h>
+#endif
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+using namespace yarp::sig;
+using namespace yarp::math;
+
+/**
+ * One component of the stack running as a local process.
+ */
+class Component
+{
+    string name;
+    string path;
+    int    pid;
+
+public:
+    /**********************************************************/
+    Component(const string &name, const string &binDir) : name(name), pid(-1)
+    {
+        path=binDir.empty()?name:binDir+"/"+name;
+    }
+
+    /**********************************************************/
+    const string &getName() const { return name; }
+    bool isRunning() const        { return (pid>0); }
+
+    /**********************************************************/
+    bool start()
+    {
+    #ifndef _WIN32
+        pid=(int)fork();
+        if (pid==0)
+        {
+            execlp(path.c_str(),path.c_str(),(char*)NULL);
+            _exit(127);
+        }
+
+        return (pid>0);
+    #else
+        return false;
+    #endif
+    }
+
+    /**********************************************************/
+    void stop()
+    {
+    #ifndef _WIN32
+        if (pid<=0)
+            return;
+
+        // give the component the chance to quit gracefully
+        kill((pid_t)pid,SIGINT);
+        for (double t0=Time::now(); Time::now()-t0<5.0; Time::delay(0.1))
+            if (waitpid((pid_t)pid,NULL,WNOHANG)==(pid_t)pid)
+            {
+                pid=-1;
+                return;
+            }
+
+        kill((pid_t)pid,SIGKILL);
+        waitpid((pid_t)pid,NULL,0);
+        pid=-1;
+    #endif
+    }
+
+    /**
+     * The CPU time consumed so far in [s], or a negative value
+     * when not available (the figures come from procfs).
+     */
+    double getCpuTime() const
+    {
+        if (pid<=0)
+            return -1.0;
+
+        ostringstream file;
+        file<<"/proc/"<<pid<<"/stat";
+        ifstream fin(file.str().c_str());
+        string stat;
+        if (!getline(fin,stat))
+            return -1.0;
+
+        // the fields past the command name, which is enclosed within
+        // parentheses, start with the state: utime and stime are the
+        // 14th and 15th fields overall
+        size_t pos=stat.rfind(')');
+        if (pos==string::npos)
+            return -1.0;
+
+        istringstream str(stat.substr(pos+1));
+        string field;
+        double utime=0.0,stime=0.0;
+        for (int i=3; i<=15; i++)
+        {
+            if (!(str>>field))
+                return -1.0;
+            if (i==14)
+                utime=atof(field.c_str());
+            else if (i==15)
+                stime=atof(field.c_str());
+        }
+
+    #ifndef _WIN32
+        return (utime+stime)/sysconf(_SC_CLK_TCK);
+    #else
+        return -1.0;
+    #endif
+    }
+};
+
+/**
+ * Collect the time stamps of the pose streamed by the server,
+ * which tell the period of its control loop.
+ */
+class StatePort : public BufferedPort<Vector>
+{
+    Semaphore      mutex;
+    vector<double> stamps;
+    bool           recording;
+
+    /**********************************************************/
+    void onRead(Vector &pose)
+    {
+        Stamp info;
+        getEnvelope(info);
+
+        mutex.wait();
+        if (recording && info.isValid() && (stamps.size()<stamps.capacity()))
+            stamps.push_back(info.getTime());
+        mutex.post();
+    }
+
+public:
+    /**********************************************************/
+    StatePort() : recording(false)
+    {
+        stamps.reserve(1000000);
+        useCallback();
+    }
+
+    /**********************************************************/
+    void record(const bool on)
+    {
+        mutex.wait();
+        recording=on;
+        mutex.post();
+    }
+
+    /**
+     * The periods in [ms].
+     */
+    vector<double> getPeriods()
+    {
+        vector<double> periods;
+        mutex.wait();
+        for (size_t i=1; i<stamps.size(); i++)
+            periods.push_back(1000.0*(stamps[i]-stamps[i-1]));
+        mutex.post();
+
+        return periods;
+    }
+};
+
+/**********************************************************/
+double getSelfCpuTime()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_utime.tv_sec+1e-6*usage.ru_utime.tv_usec+
+           usage.ru_stime.tv_sec+1e-6*usage.ru_stime.tv_usec;
+#else
+    return -1.0;
+#endif
+}
+
+/**********************************************************/
+void numberToJson(const double x, ostream &out)
+{
+    // NaN and Inf have no counterpart in JSON
+    if ((x!=x) || (fabs(x)>DBL_MAX))
+        out<<"null";
+    else
+        out<<x;
+}
+
+/**********************************************************/
+void stringToJson(const string &str, ostream &out)
+{
+    out<<"\"";
+    for (size_t i=0; i<str.length(); i++)
+    {
+        char c=str[i];
+        if ((c=='\"') || (c=='\\'))
+            out<<'\\'<<c;
+        else if (c=='\n')
+            out<<"\\n";
+        else if (c=='\r')
+            out<<"\\r";
+        else if (c=='\t')
+            out<<"\\t";
+        else if ((unsigned char)c<0x20)
+        {
+            char buf[8];
+            sprintf(buf,"\\u%04x",(unsigned int)(unsigned char)c);
+            out<<buf;
+        }
+        else
+            out<<c;
+    }
+    out<<"\"";
+}
+
+/**********************************************************/
+void distributionToJson(vector<double> samples, ostream &out)
+{
+    out<<"{\"count\": "<<samples.size();
+    if (!samples.empty())
+    {
+        sort(samples.begin(),samples.end());
+
+        double mean=0.0;
+        for (size_t i=0; i<samples.size(); i++)
+            mean+=samples[i];
+        mean/=samples.size();
+
+        double var=0.0;
+        for (size_t i=0; i<samples.size(); i++)
+            var+=(samples[i]-mean)*(samples[i]-mean);
+        var/=samples.size();
+
+        out<<", \"mean\": "; numberToJson(mean,out);
+        out<<", \"std\": ";  numberToJson(sqrt(var),out);
+        out<<", \"min\": ";  numberToJson(samples.front(),out);
+        out<<", \"p50\": ";  numberToJson(samples[(size_t)(0.5*(samples.size()-1))],out);
+        out<<", \"p90\": ";  numberToJson(samples[(size_t)(0.9*(samples.size()-1))],out);
+        out<<", \"p99\": ";  numberToJson(samples[(size_t)(0.99*(samples.size()-1))],out);
+        out<<", \"max\": ";  numberToJson(samples.back(),out);
+    }
+    out<<"}";
+}
+
+/**********************************************************/
+void listToJson(const Bottle &b, const int start, ostream &out);
+
+/**********************************************************/
+void valueToJson(const Value &v, ostream &out)
+{
+    if (v.isInt() || v.isDouble())
+        numberToJson(v.asDouble(),out);
+    else if (v.isList())
+        listToJson(*v.asList(),0,out);
+    else
+        stringToJson(v.asString().c_str(),out);
+}
+
+/**
+ * The lists made of (key value ...) turn into objects, whereas
+ * the others turn into arrays.
+ */
+void listToJson(const Bottle &b, const int start, ostream &out)
+{
+    bool object=(b.size()>start);
+    for (int i=start; i<b.size(); i++)
+    {
+        Bottle *item=b.get(i).asList();
+        if ((item==NULL) || (item->size()<1) || !item->get(0).isString())
+            object=false;
+    }
+
+    out<<(object?"{":"[");
+    for (int i=start; i<b.size(); i++)
+    {
+        if (i>start)
+            out<<", ";
+
+        if (object)
+        {
+            Bottle *item=b.get(i).asList();
+            stringToJson(item->get(0).asString().c_str(),out);
+            out<<": ";
+            if (item->size()==2)
+                valueToJson(item->get(1),out);
+            else
+                listToJson(*item,1,out);
+        }
+        else
+            valueToJson(b.get(i),out);
+    }
+    out<<(object?"}":"]");
+}
+
+/**********************************************************/
+double cpuLoad(const double cpu0, const double cpu1, const double wall)
+{
+    return ((cpu0<0.0) || (cpu1<0.0) || (wall<=0.0))?-1.0:100.0*(cpu1-cpu0)/wall;
+}
+
+/**********************************************************/
+Vector randomTarget()
+{
+    Vector xd(3);
+    xd[0]=Rand::scalar(1.0,2.5);
+    xd[1]=Rand::scalar(0.0,2.0);
+    xd[2]=0.0;
+    return xd;
+}
+
+/**********************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help"))
+    {
+        cout<<"Options:"<<endl;
+        cout<<"\t--spawn      <on|off> launch fakeRobot, solver and server (default: on)"<<endl;
+        cout<<"\t--bin_dir    <string> directory of the executables (default: the PATH)"<<endl;
+        cout<<"\t--robot      <string> name of the fake robot (default: fake_robot)"<<endl;
+        cout<<"\t--solver     <string> name of the solver (default: solver)"<<endl;
+        cout<<"\t--server     <string> name of the server (default: server)"<<endl;
+        cout<<"\t--asks       <int>    number of targets solved only (default: 50)"<<endl;
+        cout<<"\t--targets    <int>    number of targets reached (default: 20)"<<endl;
+        cout<<"\t--seed       <int>    seed of the targets (default: 1)"<<endl;
+        cout<<"\t--traj_time  <double> trajectory time in [s] (default: 1.0)"<<endl;
+        cout<<"\t--tol        <double> in-target tolerance (default: 1e-3)"<<endl;
+        cout<<"\t--timeout    <double> time given to each target in [s] (default: 10.0)"<<endl;
+        cout<<"\t--ctrl_period <int>   nominal period of the server in [ms] (default: 20)"<<endl;
+        cout<<"\t--out        <string> file of the results in JSON (default: benchPipeline.json)"<<endl;
+        return 0;
+    }
+
+    if (!yarp.checkNetwork())
+    {
+        cout<<"Error: yarp server does not seem available"<<endl;
+        return 1;
+    }
+
+    bool spawn=(rf.check("spawn",Value("on")).asString()=="on");
+    string binDir=rf.check("bin_dir",Value("")).asString().c_str();
+    string robot=rf.check("robot",Value("fake_robot")).asString().c_str();
+    string solver=rf.check("solver",Value("solver")).asString().c_str();
+    string server=rf.check("server",Value("server")).asString().c_str();
+    int asks=rf.check("asks",Value(50)).asInt();
+    int targets=rf.check("targets",Value(20)).asInt();
+    int seed=rf.check("seed",Value(1)).asInt();
+    double trajTime=rf.check("traj_time",Value(1.0)).asDouble();
+    double tol=rf.check("tol",Value(1e-3)).asDouble();
+    double timeout=rf.check("timeout",Value(10.0)).asDouble();
+    double ctrlPeriod=rf.check("ctrl_period",Value(20)).asDouble();
+    string outFile=rf.check("out",Value("benchPipeline.json")).asString().c_str();
+
+#ifdef _WIN32
+    if (spawn)
+    {
+        cout<<"Error: launch the components by hand and use --spawn off"<<endl;
+        return 1;
+    }
+#endif
+
+    // the components are launched one after the other, each
+    // waiting for the one it depends on to become available
+    vector<Component> components;
+    components.push_back(Component("fakeRobot",binDir));
+    components.push_back(Component("solver",binDir));
+    components.push_back(Component("server",binDir));
+
+    string readiness[]={"/"+robot+"/fake_part/rpc","/"+solver+"/rpc"};
+
+    bool ok=true;
+    for (size_t i=0; spawn && (i<components.size()) && ok; i++)
+    {
+        cout<<"Launching "<<components[i].getName()<<" ..."<<endl;
+        ok=components[i].start();
+
+        if (ok && (i<sizeof(readiness)/sizeof(readiness[0])))
+        {
+            ok=false;
+            for (double t0=Time::now(); Time::now()-t0<20.0; Time::delay(0.1))
+                if (Network::exists(readiness[i].c_str()))
+                {
+                    ok=true;
+                    break;
+                }
+        }
+    }
+
+    // the server is ready as soon as the client can connect
+    Property option("(device cartesiancontrollerclient)");
+    option.put("remote",("/"+server).c_str());
+    option.put("local","/benchPipeline/client");
+
+    PolyDriver client;
+    for (double t0=Time::now(); ok && (Time::now()-t0<20.0); Time::delay(0.5))
+        if (client.open(option))
+            break;
+
+    ICartesianControl *arm=NULL;
+    if (!ok || !client.isValid() || !client.view(arm))
+    {
+        cout<<"Error: unable to set up the stack"<<endl;
+        for (size_t i=components.size(); i>0; i--)
+            components[i-1].stop();
+        return 1;
+    }
+
+    arm->setTrajTime(trajTime);
+    arm->setInTargetTol(tol);
+
+    StatePort statePort;
+    statePort.open("/benchPipeline/state:i");
+    Network::connect(("/"+server+"/state:o").c_str(),statePort.getName().c_str());
+
+    RpcClient robotPort;
+    robotPort.open("/benchPipeline/robot:rpc");
+    Network::connect(robotPort.getName().c_str(),("/"+robot+"/fake_part/rpc").c_str());
+
+    Bottle cmd,reply;
+    cmd.addVocab(Vocab::encode("stat"));
+    cmd.addVocab(Vocab::encode("rst"));
+    robotPort.write(cmd,reply);
+
+    Rand::init(seed);
+
+    vector<double> cpu0(components.size());
+    for (size_t i=0; i<components.size(); i++)
+        cpu0[i]=components[i].getCpuTime();
+    double selfCpu0=getSelfCpuTime();
+    double wall0=Time::now();
+
+    // the solver alone: the time includes the round trip
+    // from the client through the server
+    cout<<"Solving for "<<asks<<" targets ..."<<endl;
+    vector<double> solveTimes;
+    for (int i=0; i<asks; i++)
+    {
+        Vector xd=randomTarget();
+        Vector xdhat,odhat,qdhat;
+
+        double t0=Time::now();
+        if (arm->askForPosition(xd,xdhat,odhat,qdhat))
+            solveTimes.push_back(1000.0*(Time::now()-t0));
+    }
+
+    // the whole pipeline
+    cout<<"Reaching for "<<targets<<" targets ..."<<endl;
+    vector<double> reachTimes,errors,desiredErrors;
+    int failures=0;
+
+    statePort.record(true);
+    for (int i=0; i<targets; i++)
+    {
+        Vector xd=randomTarget();
+
+        double t0=Time::now();
+        arm->goToPositionSync(xd);
+
+        bool done=false;
+        while (!done && (Time::now()-t0<timeout))
+        {
+            Time::delay(0.01);
+            arm->checkMotionDone(&done);
+        }
+
+        if (!done)
+        {
+            failures++;
+            arm->stopControl();
+            continue;
+        }
+
+        reachTimes.push_back(Time::now()-t0);
+
+        Vector x,o,xdhat,odhat,qdhat;
+        arm->getPose(x,o);
+        arm->getDesired(xdhat,odhat,qdhat);
+        errors.push_back(norm(xd-x));
+        desiredErrors.push_back(norm(xdhat-x));
+    }
+    statePort.record(false);
+
+    double wall=Time::now()-wall0;
+    double selfCpu1=getSelfCpuTime();
+    vector<double> cpu1(components.size());
+    for (size_t i=0; i<components.size(); i++)
+        cpu1[i]=components[i].getCpuTime();
+
+    cmd.clear();
+    cmd.addVocab(Vocab::encode("stat"));
+    cmd.addVocab(Vocab::encode("get"));
+    reply.clear();
+    robotPort.write(cmd,reply);
+
+    // the deviation from the nominal period of the server
+    vector<double> periods=statePort.getPeriods();
+    vector<double> deviations;
+    for (size_t i=0; i<periods.size(); i++)
+        deviations.push_back(fabs(periods[i]-ctrlPeriod));
+
+    ofstream out(outFile.c_str());
+    out<<setprecision(6);
+    out<<"{"<<endl;
+    out<<"  \"benchmark\": \"pipeline\","<<endl;
+    out<<"  \"version\": 1,"<<endl;
+    out<<"  \"config\": {\"asks\": "<<asks<<", \"targets\": "<<targets
+       <<", \"seed\": "<<seed<<", \"traj_time\": "<<trajTime<<", \"tol\": "<<tol
+       <<", \"timeout\": "<<timeout<<", \"ctrl_period\": "<<ctrlPeriod
+       <<", \"spawn\": "<<(spawn?"true":"false")<<"},"<<endl;
+    out<<"  \"solve_time_ms\": "; distributionToJson(solveTimes,out); out<<","<<endl;
+    out<<"  \"server_period_ms\": "; distributionToJson(periods,out); out<<","<<endl;
+    out<<"  \"server_deviation_ms\": "; distributionToJson(deviations,out); out<<","<<endl;
+    out<<"  \"time_to_target_s\": "; distributionToJson(reachTimes,out); out<<","<<endl;
+    out<<"  \"error_to_target\": "; distributionToJson(errors,out); out<<","<<endl;
+    out<<"  \"error_to_desired\": "; distributionToJson(desiredErrors,out); out<<","<<endl;
+    out<<"  \"failures\": "<<failures<<","<<endl;
+    out<<"  \"wall_time_s\": "; numberToJson(wall,out); out<<","<<endl;
+
+    // the load of each component in [%] of one core,
+    // negative when not available
+    out<<"  \"cpu_percent\": {";
+    for (size_t i=0; i<components.size(); i++)
+    {
+        stringToJson(components[i].getName(),out);
+        out<<": "; numberToJson(cpuLoad(cpu0[i],cpu1[i],wall),out); out<<", ";
+    }
+    out<<"\"client\": "; numberToJson(cpuLoad(selfCpu0,selfCpu1,wall),out); out<<"},"<<endl;
+
+    out<<"  \"fake_robot\": ";
+    if (reply.get(0).asVocab()==Vocab::encode("ack"))
+        listToJson(reply,1,out);
+    else
+        out<<"null";
+    out<<endl<<"}"<<endl;
+    out.close();
+
+    cout<<"Targets reached: "<<reachTimes.size()<<"/"<<targets<<endl;
+    cout<<"Results written to "<<outFile<<endl;
+
+    statePort.interrupt();
+    statePort.close();
+    robotPort.close();
+    client.close();
+
+    for (size_t i=components.size(); i>0; i--)
+        components[i-1].stop();
+
+    return 0;
+}
+
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <private/fakeMotorDeviceSnapshot.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+
+/**
+ * The state shared between the writer and the readers.
+ */
+class StateSource
+{
+public:
+    virtual void write(const Vector &encs, const Stamp &stamp)=0;
+    virtual bool read(double *encs)=0;
+    virtual ~StateSource() { }
+};
+
+/**
+ * The former path of the client: one semaphore guarding a Vector.
+ */
+class SemaphoreSource : public StateSource
+{
+    Semaphore mutex;
+    Vector    encs;
+
+public:
+    /**********************************************************/
+    void write(const Vector &encs, const Stamp &stamp)
+    {
+        mutex.wait();
+        this->encs=encs;
+        mutex.post();
+    }
+
+    /**********************************************************/
+    bool read(double *encs)
+    {
+        mutex.wait();
+        for (size_t i=0; i<this->encs.length(); i++)
+            encs[i]=this->encs[i];
+        mutex.post();
+
+        return true;
+    }
+};
+
+/**
+ * The current path of the client: the sequence lock.
+ */
+class SeqLockSource : public StateSource
+{
+    fakeMotorStateSnapshot snapshot;
+
+public:
+    /**********************************************************/
+    SeqLockSource(const size_t axes) { snapshot.resize(axes); }
+
+    /**********************************************************/
+    void write(const Vector &encs, const Stamp &stamp)
+    {
+        snapshot.write(encs,stamp,Time::now());
+    }
+
+    /**********************************************************/
+    bool read(double *encs)
+    {
+        double stampTime,rxTime;
+        return snapshot.read(encs,stampTime,rxTime);
+    }
+};
+
+/**
+ * Time the given operation in [ns].
+ */
+template<class F>
+double timeit(F op)
+{
+    chrono::steady_clock::time_point t0=chrono::steady_clock::now();
+    op();
+    chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+    return (double)chrono::duration_cast<chrono::nanoseconds>(t1-t0).count();
+}
+
+/**
+ * The writer emulates the state port callback.
+ */
+class Writer : public RateThread
+{
+    StateSource    &source;
+    Vector          encs;
+    Stamp           stamp;
+    vector<double> &lat;
+
+public:
+    /**********************************************************/
+    Writer(StateSource &source, const size_t axes, const int period,
+           vector<double> &lat) : RateThread(period), source(source),
+                                  encs(axes,0.0), lat(lat) { }
+
+    /**********************************************************/
+    void run()
+    {
+        for (size_t i=0; i<encs.length(); i++)
+            encs[i]+=1.0;
+        stamp.update();
+
+        double dt=timeit([&]() { source.write(encs,stamp); });
+        if (lat.size()<lat.capacity())
+            lat.push_back(dt);
+    }
+};
+
+/**
+ * The reader emulates a controller thread polling the encoders.
+ */
+class Reader : public Thread
+{
+    StateSource    &source;
+    vector<double>  encs;
+    vector<double> &lat;
+    double          pause;
+
+public:
+    /**********************************************************/
+    Reader(StateSource &source, const size_t axes, const double pause,
+           vector<double> &lat) : source(source), encs(axes,0.0),
+                                  lat(lat), pause(pause) { }
+
+    /**********************************************************/
+    void run()
+    {
+        while (!isStopping() && (lat.size()<lat.capacity()))
+        {
+            double dt=timeit([&]() { source.read(encs.data()); });
+            lat.push_back(dt);
+
+            if (pause>0.0)
+                Time::delay(pause);
+        }
+    }
+};
+
+/**********************************************************/
+void report(const string &name, vector<double> &lat)
+{
+    if (lat.empty())
+        return;
+
+    sort(lat.begin(),lat.end());
+    double p[]={0.5,0.9,0.99,0.999};
+
+    cout<<setw(22)<<left<<name<<right;
+    for (size_t i=0; i<sizeof(p)/sizeof(p[0]); i++)
+        cout<<setw(10)<<fixed<<setprecision(0)<<lat[(size_t)(p[i]*(lat.size()-1))];
+    cout<<setw(10)<<lat.back()<<setw(10)<<lat.size()<<endl;
+}
+
+/**********************************************************/
+void benchmark(const string &name, StateSource &source, ResourceFinder &rf)
+{
+    size_t axes=(size_t)rf.check("axes",Value(16)).asInt();
+    int readers=rf.check("readers",Value(4)).asInt();
+    int period=rf.check("period",Value(1)).asInt();
+    double duration=rf.check("duration",Value(5.0)).asDouble();
+    double pause=rf.check("pause",Value(0.0001)).asDouble();
+
+    // the samples are pre-allocated not to perturb the timing
+    size_t capacity=(size_t)(duration/std::max(pause,1e-6));
+    vector<double> wlat; wlat.reserve((size_t)(1000.0*duration/period));
+    vector<vector<double> > rlat(readers);
+    for (int i=0; i<readers; i++)
+        rlat[i].reserve(capacity);
+
+    Writer writer(source,axes,period,wlat);
+    writer.start();
+    Time::delay(0.1);
+
+    vector<Reader*> pool;
+    for (int i=0; i<readers; i++)
+    {
+        pool.push_back(new Reader(source,axes,pause,rlat[i]));
+        pool.back()->start();
+    }
+
+    Time::delay(duration);
+
+    for (size_t i=0; i<pool.size(); i++)
+    {
+        pool[i]->stop();
+        delete pool[i];
+    }
+    writer.stop();
+
+    vector<double> all;
+    for (int i=0; i<readers; i++)
+        all.insert(all.end(),rlat[i].begin(),rlat[i].end());
+
+    report(name+" [read]",all);
+    report(name+" [write]",wlat);
+}
+
+
+/**********************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help"))
+    {
+        cout<<"Options:"<<endl;
+        cout<<"\t--axes     <int>    number of axes (default: 16)"<<endl;
+        cout<<"\t--readers  <int>    number of polling threads (default: 4)"<<endl;
+        cout<<"\t--period   <int>    writer period in [ms] (default: 1)"<<endl;
+        cout<<"\t--duration <double> duration of each run in [s] (default: 5.0)"<<endl;
+        cout<<"\t--pause    <double> readers pause between reads in [s] (default: 0.0001)"<<endl;
+        return 0;
+    }
+
+    size_t axes=(size_t)rf.check("axes",Value(16)).asInt();
+
+    cout<<"latencies in [ns]"<<endl;
+    cout<<setw(22)<<left<<"path"<<right
+        <<setw(10)<<"p50"<<setw(10)<<"p90"<<setw(10)<<"p99"
+        <<setw(10)<<"p99.9"<<setw(10)<<"max"<<setw(10)<<"samples"<<endl;
+
+    SemaphoreSource semaphore;
+    benchmark("semaphore",semaphore,rf);
+
+    SeqLockSource seqlock(axes);
+    benchmark("seqlock",seqlock,rf);
+
+    return 0;
+}
+
+
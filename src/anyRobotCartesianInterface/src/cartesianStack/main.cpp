@@ -0,0 +1,177 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <yarp/os/all.h>
+#include <fakeMotorDevice.h>
+#include "fakeRobotLauncher.h"
+#include "solverModule.h"
+#include "serverModule.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace yarp::os;
+
+/**
+ * This class runs the fake robot, the solver and the server in one
+ * single process with local name resolution, in the same order they
+ * are launched by robot_server_solver.xml. Each component is given its own
+ * ResourceFinder, configured from the command line along with its
+ * usual configuration file (see the options robot_config,
+ * solver_config and server_config).
+ *
+ * The motor clients of the solver and of the server are attached
+ * straight to the fake robot through the "inproc" carrier, whereas
+ * the ports linking the server to the solver are resolved within
+ * the process, no name server being involved. Note that the stack is
+ * not free of inter-process communication though: in local mode every
+ * port still binds its own socket and the links other than the motor
+ * ones still go through the loopback.
+ */
+class StackModule: public RFModule
+{
+protected:
+    int    argc;
+    char **argv;
+
+    ResourceFinder rfRobot;
+    ResourceFinder rfSolver;
+    ResourceFinder rfServer;
+
+    fakeRobotModule::Launcher  robot;
+    solverModule::SolverModule solver;
+    serverModule::ServerModule server;
+
+    bool robotOpen;
+    bool solverOpen;
+    bool serverOpen;
+
+public:
+    /**********************************************************/
+    StackModule(int argc, char *argv[]) : argc(argc), argv(argv), robotOpen(false),
+                                          solverOpen(false), serverOpen(false) { }
+
+    /**********************************************************/
+    bool configure(ResourceFinder &rf)
+    {
+        string carrier=rf.check("carrier",Value("inproc")).asString().c_str();
+
+        rfRobot.setVerbose(true);
+        rfRobot.setDefaultConfigFile(rf.check("robot_config",Value("fakeRobot.ini")).asString().c_str());
+        rfRobot.setDefault("robot","fake_robot");
+        rfRobot.setDefault("part","fake_part");
+        rfRobot.configure(argc,argv);
+
+        rfSolver.setVerbose(true);
+        rfSolver.setDefaultConfigFile(rf.check("solver_config",Value("solver.ini")).asString().c_str());
+        rfSolver.setDefault("kinematics_file","kinematics.ini");
+        rfSolver.setDefault("carrier",carrier.c_str());
+        rfSolver.configure(argc,argv);
+
+        rfServer.setVerbose(true);
+        rfServer.setDefaultConfigFile(rf.check("server_config",Value("server.ini")).asString().c_str());
+        rfServer.setDefault("robot","fake_robot");
+        rfServer.setDefault("part","fake_part");
+        rfServer.setDefault("local","server");
+        rfServer.setDefault("kinematics_file","kinematics.ini");
+        rfServer.setDefault("carrier",carrier.c_str());
+        rfServer.configure(argc,argv);
+
+        // the robot comes first since the clients attach to
+        // it, then the solver the server connects to
+        if (!(robotOpen=robot.configure(rfRobot)))
+        {
+            cout<<"Error: unable to launch the fake robot!"<<endl;
+            return false;
+        }
+
+        if (!(solverOpen=solver.configure(rfSolver)))
+        {
+            cout<<"Error: unable to launch the solver!"<<endl;
+            close();
+            return false;
+        }
+
+        if (!(serverOpen=server.configure(rfServer)))
+        {
+            cout<<"Error: unable to launch the server!"<<endl;
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    /**********************************************************/
+    bool interruptModule()
+    {
+        if (solverOpen)
+            solver.interruptModule();
+
+        return true;
+    }
+
+    /**********************************************************/
+    bool close()
+    {
+        // tear down in reverse order
+        if (serverOpen)
+            server.close();
+
+        if (solverOpen)
+            solver.close();
+
+        if (robotOpen)
+            robot.close();
+
+        robotOpen=solverOpen=serverOpen=false;
+        return true;
+    }
+
+    /**********************************************************/
+    double getPeriod() { return 1.0; }
+
+    /**********************************************************/
+    bool updateModule()
+    {
+        return solver.updateModule();
+    }
+};
+
+
+/**********************************************************/
+int main(int argc, char *argv[])
+{
+    // the names are resolved within the process, hence no name
+    // server is required, yet the ports keep binding their sockets
+    Network yarp;
+    Network::setLocalMode(true);
+
+    // register here the new yarp devices
+    // for dealing with the fake robot
+    registerFakeMotorDevices();
+
+    ResourceFinder rf;
+    rf.setVerbose(true);
+    rf.configure(argc,argv);
+
+    StackModule stack(argc,argv);
+    return stack.runModule(rf);
+}
+
+
@@ -24,6 +24,10 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <math.h>
 
 using namespace std;
 using namespace yarp::os;
@@ -31,6 +35,237 @@ using namespace yarp::dev;
 using namespace yarp::sig;
 using namespace yarp::math;
 
+/**
+ * This class receives the state streamed by the server, which
+ * echoes the id of the latest target taken by the controller, and
+ * measures for each target the latency until it is echoed (ack)
+ * and for each step of the target the latency until the
+ * end-effector is seen moving toward the new target (motion). The
+ * targets superseded by newer ones before being taken and those
+ * rejected by the controller are counted apart.
+ */
+class LatencyMonitor : public BufferedPort<Vector>
+{
+    Semaphore mutex;
+    deque<pair<int,double> > sent;
+    vector<double> ackLat,motionLat;
+    Vector stepTarget;
+    int lastEcho,stepSeq;
+    double stepTime,motionTol;
+    double superseded,rejected;
+    double reportedSuperseded,reportedRejected;
+
+    /**********************************************************/
+    void onRead(Vector &state)
+    {
+        double now=Time::now();
+
+        Stamp info;
+        getEnvelope(info);
+        int echo=info.getCount();
+
+        mutex.wait();
+
+        if (echo>lastEcho)
+        {
+            while (!sent.empty() && (sent.front().first<echo))
+                sent.pop_front();
+
+            if (!sent.empty() && (sent.front().first==echo))
+                ackLat.push_back(now-sent.front().second);
+
+            lastEcho=echo;
+        }
+
+        if (state.length()>=12)
+        {
+            // the first counters received are the baseline
+            if (superseded<0.0)
+            {
+                reportedSuperseded=state[10];
+                reportedRejected=state[11];
+            }
+
+            superseded=state[10];
+            rejected=state[11];
+        }
+
+        // the speed along the direction to the new target
+        // once the controller has taken it
+        if ((stepSeq>=0) && (echo>=stepSeq) && (state.length()>=10))
+        {
+            double d[3],n=0.0,v=0.0;
+            for (size_t i=0; i<3; i++)
+            {
+                d[i]=stepTarget[i]-state[i];
+                n+=d[i]*d[i];
+            }
+
+            n=sqrt(n);
+            if (n>0.0)
+                for (size_t i=0; i<3; i++)
+                    v+=state[7+i]*d[i]/n;
+
+            if (v>motionTol)
+            {
+                motionLat.push_back(now-stepTime);
+                stepSeq=-1;
+            }
+        }
+
+        mutex.post();
+    }
+
+    /**********************************************************/
+    static void report(const string &name, vector<double> &lat)
+    {
+        cout<<name<<" latency [ms]: ";
+        if (lat.empty())
+        {
+            cout<<"n/a"<<endl;
+            return;
+        }
+
+        sort(lat.begin(),lat.end());
+        double mean=0.0;
+        for (size_t i=0; i<lat.size(); i++)
+            mean+=lat[i];
+        mean/=lat.size();
+
+        cout<<"mean "<<1e3*mean<<"; p50 "<<1e3*lat[lat.size()/2]
+            <<"; p95 "<<1e3*lat[(size_t)(0.95*(lat.size()-1))]
+            <<"; max "<<1e3*lat.back()<<" ("<<lat.size()<<" samples)"<<endl;
+
+        lat.clear();
+    }
+
+public:
+    /**********************************************************/
+    LatencyMonitor() : stepTarget(3,0.0), lastEcho(-1), stepSeq(-1), stepTime(0.0),
+                       motionTol(1e-3), superseded(-1.0), rejected(-1.0),
+                       reportedSuperseded(0.0), reportedRejected(0.0)
+    {
+        useCallback();
+    }
+
+    /**********************************************************/
+    void setMotionTol(const double tol) { motionTol=tol; }
+
+    /**
+     * Keep track of the target just sent.
+     */
+    void addTarget(const int seq, const double t)
+    {
+        mutex.wait();
+        sent.push_back(make_pair(seq,t));
+        if (sent.size()>1024)
+            sent.pop_front();
+        mutex.post();
+    }
+
+    /**
+     * Keep track of a step of the target, i.e. of the first target
+     * sent toward a new position.
+     */
+    void addStep(const int seq, const double t, const Vector &xd)
+    {
+        mutex.wait();
+        stepSeq=seq;
+        stepTime=t;
+        stepTarget=xd.subVector(0,2);
+        mutex.post();
+    }
+
+    /**
+     * Print the statistics collected since the previous call.
+     */
+    void report()
+    {
+        mutex.wait();
+        report("ack",ackLat);
+        report("motion",motionLat);
+        if (superseded>=0.0)
+        {
+            cout<<"superseded targets: "<<superseded-reportedSuperseded
+                <<"; rejected targets: "<<rejected-reportedRejected<<endl;
+            reportedSuperseded=superseded;
+            reportedRejected=rejected;
+        }
+        mutex.post();
+    }
+};
+
+/**
+ * This class emulates a perception pipeline streaming targets at
+ * a fixed rate: the target steps every stepPeriod seconds to the
+ * next point out of a given number evenly spaced along a circle in
+ * the plane of the manipulator, so that the end-effector settles
+ * in between the steps. The targets are tagged with their sequence
+ * ids and are written without waiting, the port dropping those
+ * still to be sent when a newer one is ready (latest-wins).
+ */
+class TargetStreamer : public RateThread
+{
+    BufferedPort<Vector> port;
+    LatencyMonitor &monitor;
+    Vector xd;
+    double t0,stepPeriod;
+    int steps,step,seq;
+
+public:
+    /**********************************************************/
+    TargetStreamer(LatencyMonitor &monitor, const double rate, const double stepPeriod,
+                   const int steps) : RateThread((int)(1000.0/rate)), monitor(monitor),
+                   xd(3,0.0), t0(0.0), stepPeriod(stepPeriod), steps(steps>1?steps:2),
+                   step(-1), seq(0) { }
+
+    /**********************************************************/
+    bool open(const string &name) { return port.open(name.c_str()); }
+
+    /**********************************************************/
+    string getName() { return port.getName().c_str(); }
+
+    /**********************************************************/
+    bool threadInit()
+    {
+        t0=Time::now();
+        return true;
+    }
+
+    /**********************************************************/
+    void threadRelease()
+    {
+        port.interrupt();
+        port.close();
+    }
+
+    /**********************************************************/
+    void run()
+    {
+        double t=Time::now();
+        int k=(int)((t-t0)/stepPeriod);
+
+        seq++;
+        if (k!=step)
+        {
+            double phi=2.0*M_PI*(k%steps)/steps;
+            xd[0]=1.75+0.5*cos(phi);
+            xd[1]=1.0+0.5*sin(phi);
+            xd[2]=0.0;
+
+            monitor.addStep(seq,t,xd);
+            step=k;
+        }
+
+        port.prepare()=xd;
+
+        monitor.addTarget(seq,t);
+        Stamp stamp(seq,t);
+        port.setEnvelope(stamp);
+        port.write();
+    }
+};
+
 /**
  * This class implements the client.
  */
@@ -41,7 +276,14 @@ protected:
     ICartesianControl *arm;
     Vector xdhat;
 
+    // streaming mode
+    LatencyMonitor  monitor;
+    TargetStreamer *streamer;
+
 public:
+    /**********************************************************/
+    ClientModule() : streamer(NULL) { }
+
     /**********************************************************/
     bool configure(ResourceFinder &rf)
     {
@@ -56,9 +298,14 @@ public:
         if (!client.open(option))
             return false;
 
+        // in streaming mode the targets are pushed at the given rate
+        // [Hz] through <local>/target:o to <remote>/target:i, while
+        // the state echoing their ids is read from <remote>/stream:o
+        bool stream=(rf.check("stream",Value("off")).asString()=="on");
+
         // open the view
         client.view(arm);
-        arm->setTrajTime(2.0);
+        arm->setTrajTime(rf.check("traj_time",Value(stream?0.5:2.0)).asDouble());
         arm->setInTargetTol(1e-3);
 
         Vector dof;
@@ -77,12 +324,44 @@ public:
 
         Rand::init();
 
+        if (stream)
+        {
+            double rate=rf.check("rate",Value(50.0)).asDouble();
+            double stepPeriod=rf.check("step_period",Value(2.0)).asDouble();
+            int steps=rf.check("circle_steps",Value(6)).asInt();
+            monitor.setMotionTol(rf.check("motion_tol",Value(1e-3)).asDouble());
+
+            monitor.open(("/"+local+"/stream:i").c_str());
+            Network::connect(("/"+remote+"/stream:o").c_str(),monitor.getName().c_str(),"udp");
+
+            streamer=new TargetStreamer(monitor,rate,stepPeriod,steps);
+            streamer->open("/"+local+"/target:o");
+            if (!Network::connect(streamer->getName().c_str(),("/"+remote+"/target:i").c_str(),"udp"))
+            {
+                cout<<"Error: the server does not accept streamed targets!"<<endl;
+                close();
+                return false;
+            }
+
+            streamer->start();
+        }
+
         return true;
     }
 
     /**********************************************************/
     bool close()
     {
+        if (streamer!=NULL)
+        {
+            streamer->stop();
+            delete streamer;
+            streamer=NULL;
+        }
+
+        monitor.interrupt();
+        monitor.close();
+
         if (client.isValid())
             client.close();
 
@@ -92,6 +371,12 @@ public:
     /**********************************************************/
     bool updateModule()
     {
+        if (streamer!=NULL)
+        {
+            monitor.report();
+            return true;
+        }
+
         bool done=false;
         arm->checkMotionDone(&done);
         if (done)
@@ -120,7 +405,7 @@ public:
     }
 
     /**********************************************************/
-    double getPeriod() { return 0.4; }
+    double getPeriod() { return (streamer!=NULL)?2.0:0.4; }
 };
 
 
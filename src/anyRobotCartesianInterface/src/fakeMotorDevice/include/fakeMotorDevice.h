@@ -18,11 +18,51 @@
 #ifndef __FAKEMOTORDEVICE_H__
 #define __FAKEMOTORDEVICE_H__
 
+#include <yarp/os/all.h>
+
 /**
  * Register new yarp devices for fake motor handling
  */
 void registerFakeMotorDevices();
 
+/**
+ * Publish the simulated time in the network clock format, that
+ * is [sec] [nsec], so that it can serve as clock for the other
+ * components; nothing is written if the port is not connected.
+ * @param port the clock port.
+ * @param t the simulated time in [s].
+ */
+void publishFakeMotorClock(yarp::os::BufferedPort<yarp::os::Bottle> &port, const double t);
+
+/**
+ * Interface to advance the fake motors in lock-step mode, that is
+ * when the plant is not tied to the wall-clock time but is rather
+ * stepped on request. It is exposed by both the server (in-process
+ * stepping) and the client (remote stepping through the tick port).
+ */
+class IFakeMotorLockStep
+{
+public:
+    /**
+     * Advance the plant.
+     * @param n the number of sample times to advance.
+     * @return true/false on success/failure.
+     */
+    virtual bool tick(const int n=1)=0;
+
+    /**
+     * Retrieve the simulated time.
+     * @param t the time in [s] elapsed since the start of the plant.
+     * @return true/false on success/failure.
+     */
+    virtual bool getSimTime(double *t)=0;
+
+    /**
+     * Destructor.
+     */
+    virtual ~IFakeMotorLockStep() { }
+};
+
 #endif
 
 
@@ -18,11 +18,28 @@
 #ifndef __FAKEMOTORDEVICECOMPONENTS_H__
 #define __FAKEMOTORDEVICECOMPONENTS_H__
 
+#include <string>
+#include <deque>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+
 #include <yarp/os/all.h>
 #include <yarp/dev/all.h>
 #include <yarp/sig/all.h>
 
-#include <iCub/ctrl/pids.h>
+#include <fakeMotorDevice.h>
+
+#include "fakeMotorDevicePlant.h"
+#include "fakeMotorDeviceEstimator.h"
+#include "fakeMotorDeviceFrame.h"
+#include "fakeMotorDeviceStats.h"
+#include "fakeMotorDeviceLog.h"
+#include "fakeMotorDeviceFaults.h"
+#include "fakeMotorDeviceInbox.h"
+#include "fakeMotorDeviceSessions.h"
+#include "fakeMotorDeviceSnapshot.h"
 
 /**
  * This class implements the server part of the fake motor device driver.
@@ -33,19 +50,185 @@ class fakeMotorDeviceServer : public yarp::dev::DeviceDriver,
                               public yarp::os::PortReader,
                               public yarp::dev::IControlLimits,
                               public yarp::dev::IEncoders,
-                              public yarp::dev::IVelocityControl
+                              public yarp::dev::IVelocityControl,
+                              public IFakeMotorLockStep
 {
 protected:
+    class TickReader : public yarp::os::PortReader
+    {
+        fakeMotorDeviceServer *owner;
+        bool read(yarp::os::ConnectionReader &connection);
+    public:
+        TickReader() : owner(NULL)                  { }
+        void setOwner(fakeMotorDeviceServer *owner) { this->owner=owner; }
+    };
+
+    class RpcAsyncPort : public yarp::os::BufferedPort<yarp::os::Bottle>
+    {
+        fakeMotorDeviceServer *owner;
+        void onRead(yarp::os::Bottle &cmd);
+    public:
+        RpcAsyncPort() : owner(NULL)                { useCallback();     }
+        void setOwner(fakeMotorDeviceServer *owner) { this->owner=owner; }
+    };
+
     yarp::os::BufferedPort<yarp::sig::Vector> statePort;
-    yarp::os::BufferedPort<yarp::os::Bottle>  cmdPort;
+    yarp::os::BufferedPort<yarp::sig::Vector> stateExtPort;
+    fakeMotorInbox<yarp::os::Bottle>          cmdPort;
+    yarp::os::BufferedPort<fakeMotorFrame>    stateBinPort;
+    yarp::os::BufferedPort<fakeMotorFrame>    stateBin32Port;
+    fakeMotorInbox<fakeMotorFrame>            cmdBinPort;
+    yarp::os::BufferedPort<yarp::os::Bottle>  clockPort;
+    yarp::os::BufferedPort<yarp::os::Bottle>  diagPort;
     yarp::os::Port                            rpcPort;
+    yarp::os::Port                            tickPort;
+    TickReader                                tickReader;
+    RpcAsyncPort                              rpcAsyncPort;
+
+    // the pipelined rpc replies to each client on a port of its own
+    std::map<int,yarp::os::BufferedPort<yarp::os::Bottle>*> rpcReplyPorts;
+    yarp::os::Semaphore rpcReplyMutex;
+    int rpcReplyIds;
 
     yarp::os::Semaphore mutex;
+    yarp::os::Stamp     stamp;
 
-    iCub::ctrl::Integrator *motors;
+    // loop instrumentation
+    fakeMotorStats stats;
+
+    // record and replay
+    fakeMotorLogWriter *recorder;
+    fakeMotorLogReader *player;
+    size_t replayIdx;
+    size_t replayLast;
+    double replaySpeed;
+    double replayT0;
+    double replayWall0;
+    bool replayLoop;
+
+    // faults injected into the streaming links
+    fakeMotorFaults stateFaults;
+    fakeMotorFaults cmdFaults;
+    yarp::sig::Vector stateBuf;
+    yarp::sig::Vector stateOut;
+
+    // commands policy
+    yarp::sig::Vector cmdBuf;
+    yarp::os::Bottle cmdIn;
+    fakeMotorFrame cmdBinIn;
+    size_t cmdQueue;
+    double cmdMaxAge;
+    bool cmdFifo;
+
+    // commands sessions, the default one being the first
+    fakeMotorSessions sessions;
+
+    unsigned int cmdAck;
+    double cmdTime;
+    double diagPeriod;
+    double lastDiag;
+
+    // the state shared with the in-process clients
+    fakeMotorStateSnapshot snapshot;
+    std::atomic<int> peers;
+    std::string name;
+
+    fakeMotorPlant motors;
     yarp::sig::Vector vel;
+    unsigned int ticks;
+    unsigned int generation;
+
+    // speeds and accelerations estimation
+    fakeMotorEstimator estimator;
+    yarp::sig::Vector speeds;
+    yarp::sig::Vector accels;
+
+    bool lockstep;
+    bool external;
     bool configured;
 
+    friend class TickReader;
+    friend class RpcAsyncPort;
+
+    /**
+     * Advance the plant of one sample time and stream the new
+     * state. To be called with the mutex held.
+     */
+    void advance();
+
+    /**
+     * Drain the command ports according to the commands policy.
+     * @param t the current time in [s].
+     * @return true iff the velocities have been changed.
+     */
+    bool readCommands(const double t);
+
+    /**
+     * Drain the command ports of one session.
+     * @param s the session.
+     * @param t the current time in [s].
+     */
+    void readSession(fakeMotorSession &s, const double t);
+
+    /**
+     * Serve the rpc requests that open and close the reply ports
+     * of the pipelined rpc, one per client.
+     */
+    void respondRpc(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+
+    /**
+     * Fill the state with the next one stored in the log: one per
+     * tick in lock-step mode, otherwise the latest one due according
+     * to the recorded time, played at replay_speed.
+     * @param state the state to be filled.
+     * @return false if the log does not contain any state.
+     */
+    bool replay(yarp::sig::Vector &state);
+
+    /**
+     * Stream one state to the clients.
+     * @param state the state.
+     * @param stamp the envelope.
+     * @param seq the sequence number.
+     * @param ack the sequence number of the latest command applied.
+     */
+    void publish(const yarp::sig::Vector &state, yarp::os::Stamp &stamp,
+                 const unsigned int seq, const unsigned int ack);
+
+    /**
+     * Stream one state in the binary format with the given precision.
+     */
+    void publishBinary(yarp::os::BufferedPort<fakeMotorFrame> &port,
+                       const yarp::sig::Vector &state, yarp::os::Stamp &stamp,
+                       const unsigned int seq, const unsigned int ack,
+                       const bool f32);
+
+    /**
+     * Dump the statistics of the loop and of the links.
+     */
+    void statsToBottle(yarp::os::Bottle &b) const;
+
+    /**
+     * Keep one command as the next one of its session, the one
+     * kept before within the same tick being superseded.
+     * @param s the session the command belongs to.
+     * @param sp the velocities setpoints.
+     * @param dispatchTime the time the command was sent.
+     * @param t the current time.
+     * @param seq the sequence number given by the client.
+     * @param flags how the command came in (binary, stamped).
+     */
+    void offerCommand(fakeMotorSession &s, const yarp::sig::Vector &sp, const double dispatchTime,
+                      const double t, const unsigned int seq, const int flags);
+
+    /**
+     * Apply the command kept for the session unless it is stale.
+     * @param s the session.
+     * @param t the current time.
+     * @return true iff a command has been applied.
+     */
+    bool applyCommand(fakeMotorSession &s, const double t);
+
     void run();
     /**
      * This method decodes the requests forwarded by the client and
@@ -53,6 +236,11 @@ protected:
      */
     bool read(yarp::os::ConnectionReader &connection);
 
+    /**
+     * Serve one request, whatever the port it comes from.
+     */
+    void respond(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+
 public:
     fakeMotorDeviceServer();
     bool open(yarp::os::Searchable &config);
@@ -60,14 +248,76 @@ public:
 
     ////////////////////////////////////////////////////////////
     ////
-    //// IControlLimits Interface
+    //// In-process access
     ////
+    /**
+     * Retrieve the server opened within this process with the
+     * given local name, so that a client can bypass the network.
+     * The client must detach before the server gets closed.
+     * @param name the local name of the server.
+     * @return the server or NULL if not found.
+     */
+    static fakeMotorDeviceServer *attach(const std::string &name);
+
+    /**
+     * Release a server previously retrieved with attach().
+     */
+    void detach();
+
+    /**
+     * Guard the calls to the interface methods performed by the
+     * in-process clients against the server thread.
+     */
+    void lock()   { mutex.wait(); }
+    void unlock() { mutex.post(); }
+
     /**********************************************************/
-    bool getLimits(int axis, double *min, double *max);
+    const fakeMotorStateSnapshot &getSnapshot() const { return snapshot;   }
+    unsigned int getGeneration() const                { return generation; }
 
-    // not implemented
+    ////////////////////////////////////////////////////////////
+    ////
+    //// Commands sessions
+    ////
+    /**
+     * Open a session of commands, which gets its own command ports
+     * <local>/<name>/cmd:i and <local>/<name>/cmd_bin:i unless it is
+     * meant for an in-process client. Not to be called with the
+     * lock held.
+     * @param name the unique name of the session.
+     * @param priority the priority; the default session has 0.
+     * @param joints the joints the session is allowed to command;
+     *               if empty, all of them.
+     * @param ports true to open the command ports.
+     * @return the id of the session or -1 on failure.
+     */
+    int openSession(const std::string &name, const int priority,
+                    const std::vector<int> &joints, const bool ports=true);
+
+    /**
+     * Close a session, whose joints go back to the other sessions.
+     * Not to be called with the lock held.
+     * @param name the name of the session.
+     * @return true/false on success/failure.
+     */
+    bool closeSession(const std::string &name);
+
+    /**
+     * Command the velocities within the given session, meant for
+     * the in-process clients (to be called with the lock held).
+     * @param id the id of the session.
+     * @param sp the velocities setpoints.
+     * @return true/false on success/failure.
+     */
+    bool sessionMove(const int id, const double *sp);
+
+    ////////////////////////////////////////////////////////////
+    ////
+    //// IControlLimits Interface
+    ////
     /**********************************************************/
-    bool setLimits(int axis, double min, double max) { return false; }
+    bool getLimits(int axis, double *min, double *max);
+    bool setLimits(int axis, double min, double max);
 
     ////////////////////////////////////////////////////////////
     ////
@@ -75,19 +325,16 @@ public:
     ////
     /**********************************************************/
     bool getAxes(int *ax);
-
-    // not implemented
-    /**********************************************************/
-    bool getEncoder(int j, double *v)                { return false; }
-    bool getEncoders(double *encs)                   { return false; }
-    bool resetEncoder(int j)                         { return false; }
-    bool resetEncoders()                             { return false; }
-    bool setEncoder(int j, double val)               { return false; }
-    bool setEncoders(const double *vals)             { return false; } 
-    bool getEncoderSpeed(int j, double *sp)          { return false; }
-    bool getEncoderSpeeds(double *spds)              { return false; }
-    bool getEncoderAcceleration(int j, double *spds) { return false; }
-    bool getEncoderAccelerations(double *accs)       { return false; }
+    bool getEncoder(int j, double *v);
+    bool getEncoders(double *encs);
+    bool resetEncoder(int j);
+    bool resetEncoders();
+    bool setEncoder(int j, double val);
+    bool setEncoders(const double *vals);
+    bool getEncoderSpeed(int j, double *sp);
+    bool getEncoderSpeeds(double *spds);
+    bool getEncoderAcceleration(int j, double *acc);
+    bool getEncoderAccelerations(double *accs);
 
     ////////////////////////////////////////////////////////////
     ////
@@ -95,17 +342,25 @@ public:
     ////
     /**********************************************************/
     bool velocityMove(int j, double sp);
+    bool velocityMove(const double *sp);
     bool setRefAcceleration(int j, double acc);
+    bool setRefAccelerations(const double *accs);
+    bool getRefAcceleration(int j, double *acc);
+    bool getRefAccelerations(double *accs);
     bool stop(int j);
+    bool stop();
 
-    // not implemented
+    // the motors are always velocity controlled
     /**********************************************************/
-    bool setVelocityMode()                      { return false; }
-    bool velocityMove(const double *sp)         { return false; }
-    bool setRefAccelerations(const double *acc) { return false; }
-    bool getRefAcceleration(int j, double *acc) { return false; }
-    bool getRefAccelerations(double *accs)      { return false; }
-    bool stop()                                 { return false; }
+    bool setVelocityMode() { return configured; }
+
+    ////////////////////////////////////////////////////////////
+    ////
+    //// IFakeMotorLockStep Interface
+    ////
+    /**********************************************************/
+    bool tick(const int n=1);
+    bool getSimTime(double *t);
 };
 
 /**
@@ -114,8 +369,9 @@ public:
  */
 class fakeMotorDeviceClient : public yarp::dev::DeviceDriver,
                               public yarp::dev::IControlLimits,
-                              public yarp::dev::IEncoders,
-                              public yarp::dev::IVelocityControl
+                              public yarp::dev::IEncodersTimed,
+                              public yarp::dev::IVelocityControl,
+                              public IFakeMotorLockStep
 {
 protected:
     class StatePort : public yarp::os::BufferedPort<yarp::sig::Vector>
@@ -125,9 +381,9 @@ protected:
         {
             if (owner!=NULL)
             {
-                owner->mutex.wait();
-                owner->encs=encs;
-                owner->mutex.post();
+                yarp::os::Stamp info;
+                getEnvelope(info);
+                owner->snapshot.write(encs,info,yarp::os::Time::now());
             }
         }
     public:
@@ -135,16 +391,185 @@ protected:
         void setOwner(fakeMotorDeviceClient *owner) { this->owner=owner; }
     };
 
+    class StateBinPort : public yarp::os::BufferedPort<fakeMotorFrame>
+    {
+        fakeMotorDeviceClient *owner;
+        void onRead(fakeMotorFrame &frame)
+        {
+            if (owner!=NULL)
+            {
+                yarp::os::Stamp info;
+                getEnvelope(info);
+                owner->snapshot.write(frame.get(),info,yarp::os::Time::now());
+                owner->remoteGen=frame.getGen();
+            }
+        }
+    public:
+        StateBinPort() : owner(NULL)                { useCallback();     }
+        void setOwner(fakeMotorDeviceClient *owner) { this->owner=owner; }
+    };
+
+    class RpcReplyPort : public yarp::os::BufferedPort<yarp::os::Bottle>
+    {
+        fakeMotorDeviceClient *owner;
+        void onRead(yarp::os::Bottle &reply)
+        {
+            if (owner!=NULL)
+                owner->onRpcReply(reply);
+        }
+    public:
+        RpcReplyPort() : owner(NULL)                { useCallback();     }
+        void setOwner(fakeMotorDeviceClient *owner) { this->owner=owner; }
+    };
+
+    struct PendingCall
+    {
+        yarp::os::Semaphore done;
+        yarp::os::Bottle    reply;
+        PendingCall() : done(0) { }
+    };
+
     StatePort                                statePort;
     yarp::os::BufferedPort<yarp::os::Bottle> cmdPort;
+    StateBinPort                             stateBinPort;
+    yarp::os::BufferedPort<fakeMotorFrame>   cmdBinPort;
     yarp::os::RpcClient                      rpcPort;
+    yarp::os::RpcClient                      tickPort;
+    yarp::os::BufferedPort<yarp::os::Bottle> rpcAsyncPort;
+    RpcReplyPort                             rpcReplyPort;
 
-    yarp::os::Semaphore mutex;
+    yarp::os::Semaphore cmdMutex;
+
+    // pipelined rpc
+    yarp::os::Semaphore rpcMutex;
+    std::map<unsigned int,PendingCall*> pendingCalls;
+    double rpcTimeout;
+    unsigned int rpcId;
+    int rpcChannel;
+    bool pipelined;
+
+    // configuration cache, invalidated by the generation
+    // of the server configuration carried by the state
+    yarp::os::Semaphore cacheMutex;
+    yarp::sig::Matrix limCache;
+    int axesCache;
+    unsigned int cacheGen;
+    bool cacheValid;
+    std::atomic<unsigned int> remoteGen;
 
-    yarp::sig::Vector encs;
+    fakeMotorStateSnapshot snapshot;
+    fakeMotorDeviceServer *peer;
+    yarp::sig::Vector vel;
+    std::string session;
+    int sessionId;
+    unsigned int cmdSeq;
+    double timeout;
+    double syncWatchdog;
+    fakeMotorMotionWatch syncWatch;
+    yarp::os::Semaphore syncMutex;
+    std::thread::id syncOpener;
+    std::thread::id syncOwner;
+    bool stateSync;
+    bool binary;
+    bool f32;
+    bool lockstep;
     bool configured;
 
     friend class StatePort;
+    friend class StateBinPort;
+    friend class RpcReplyPort;
+
+    /**
+     * Release the reply port the server opened for the pipelined
+     * rpc of this client.
+     */
+    void closeChannel();
+
+    /**
+     * Match the replies of the pipelined rpc with the requests.
+     */
+    void onRpcReply(yarp::os::Bottle &reply);
+
+    /**
+     * Forward many requests to the server at once: they are all
+     * in flight together when the rpc is pipelined, otherwise
+     * they are served one after the other.
+     * @param cmds the requests.
+     * @param replies the corresponding replies.
+     * @return true iff all the replies have been received.
+     */
+    bool call(std::deque<yarp::os::Bottle> &cmds,
+              std::deque<yarp::os::Bottle> &replies);
+
+    /**
+     * Fetch the limits of all the axes along with the generation
+     * of the server configuration. To be called with the cache
+     * mutex held.
+     */
+    bool refreshCache();
+
+    /**
+     * Attach to the server living within the same process.
+     * @param remote the name of the server.
+     * @param priority the priority of the session, if any.
+     * @param joints the joints of the session, if any.
+     * @return true/false on success/failure.
+     */
+    bool openInProcess(const std::string &remote, const int priority,
+                       const std::vector<int> &joints);
+
+    /**
+     * Give the session of the commands back to the server.
+     */
+    void closeSession();
+
+    /**
+     * The state is shared with the server when in-process.
+     */
+    const fakeMotorStateSnapshot &getSnapshot() const
+    {
+        return (peer!=NULL)?peer->getSnapshot():snapshot;
+    }
+
+    /**
+     * Negotiate the binary format with the server.
+     * @return true if the server supports it.
+     */
+    bool negotiateBinary();
+
+    /**
+     * Tell whether a state received at the given time is not older
+     * than the staleness timeout.
+     */
+    bool isStateFresh(const double rxTime) const;
+
+    /**
+     * In state-sync mode hold the control thread, that is the
+     * first thread other than the opener calling it, until the
+     * axes move or the watchdog expires; the others do not wait.
+     */
+    void syncState();
+
+    /**
+     * Retrieve one field of the state of all the axes.
+     */
+    bool readState(const size_t field, double *dst);
+
+    /**
+     * Retrieve one field of the state of one axis.
+     */
+    bool readState(const size_t field, const int j, double *dst);
+
+    /**
+     * Send a command to the server expecting an ack.
+     */
+    bool sendCommand(yarp::os::Bottle &cmd);
+
+    /**
+     * Stream the whole vector of velocity setpoints to the server
+     * through the command port within one single message.
+     */
+    void writeVelocities();
 
 public:
     fakeMotorDeviceClient();
@@ -157,10 +582,7 @@ public:
     ////
     /**********************************************************/
     bool getLimits(int axis, double *min, double *max);
-
-    // not implemented
-    /**********************************************************/
-    bool setLimits(int axis, double min, double max) { return false; }
+    bool setLimits(int axis, double min, double max);
 
     ////////////////////////////////////////////////////////////
     ////
@@ -168,19 +590,24 @@ public:
     ////
     /**********************************************************/
     bool getAxes(int *ax);
+    bool getEncoder(int j, double *v);
     bool getEncoders(double *encs);
+    bool resetEncoder(int j);
+    bool resetEncoders();
+    bool setEncoder(int j, double val);
+    bool setEncoders(const double *vals);
+    bool getEncoderSpeed(int j, double *sp);
+    bool getEncoderSpeeds(double *spds);
+    bool getEncoderAcceleration(int j, double *acc);
+    bool getEncoderAccelerations(double *accs);
 
-    // not implemented
+    ////////////////////////////////////////////////////////////
+    ////
+    //// IEncodersTimed Interface
+    ////
     /**********************************************************/
-    bool getEncoder(int j, double *v)                { return false; }
-    bool resetEncoder(int j)                         { return false; }
-    bool resetEncoders()                             { return false; }
-    bool setEncoder(int j, double val)               { return false; }
-    bool setEncoders(const double *vals)             { return false; }
-    bool getEncoderSpeed(int j, double *sp)          { return false; }
-    bool getEncoderSpeeds(double *spds)              { return false; }
-    bool getEncoderAcceleration(int j, double *spds) { return false; }
-    bool getEncoderAccelerations(double *accs)       { return false; }
+    bool getEncodersTimed(double *encs, double *time);
+    bool getEncoderTimed(int j, double *enc, double *time);
 
     ////////////////////////////////////////////////////////////
     ////
@@ -188,17 +615,25 @@ public:
     ////
     /**********************************************************/
     bool velocityMove(int j, double sp);
+    bool velocityMove(const double *sp);
     bool setRefAcceleration(int j, double acc);
+    bool setRefAccelerations(const double *accs);
+    bool getRefAcceleration(int j, double *acc);
+    bool getRefAccelerations(double *accs);
     bool stop(int j);
+    bool stop();
 
-    // not implemented
+    // the motors are always velocity controlled
+    /**********************************************************/
+    bool setVelocityMode() { return configured; }
+
+    ////////////////////////////////////////////////////////////
+    ////
+    //// IFakeMotorLockStep Interface
+    ////
     /**********************************************************/
-    bool setVelocityMode()                      { return false; }
-    bool velocityMove(const double *sp)         { return false; }
-    bool setRefAccelerations(const double *acc) { return false; }
-    bool getRefAcceleration(int j, double *acc) { return false; }
-    bool getRefAccelerations(double *accs)      { return false; }
-    bool stop()                                 { return false; }
+    bool tick(const int n=1);
+    bool getSimTime(double *t);
 };
 
 #endif
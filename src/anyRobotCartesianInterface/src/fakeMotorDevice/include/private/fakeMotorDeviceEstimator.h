@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICEESTIMATOR_H__
+#define __FAKEMOTORDEVICEESTIMATOR_H__
+
+#include <stddef.h>
+#include <vector>
+
+#include <yarp/sig/all.h>
+
+/**
+ * This class estimates the speeds and the accelerations of the
+ * joints from the positions sampled every Ts, by fitting a line
+ * and a parabola respectively over fixed windows of the latest
+ * samples through least squares.
+ *
+ * Since the samples are evenly spaced, the fits reduce to weighted
+ * sums of the samples within the windows, which are kept up to date
+ * in place as the windows slide: each estimate costs a handful of
+ * operations per joint regardless of the size of the windows. The
+ * sums are computed anew from the history once per turn of the
+ * buffer not to accumulate the round-off errors.
+ *
+ * All the storage is allocated upon configuration.
+ */
+class fakeMotorEstimator
+{
+protected:
+    struct Window
+    {
+        size_t len;
+        double jm;      // the mean index
+        double den1;    // sum of (j-jm)^2
+        double den2;    // sum of p2(j)^2, p2(j)=(j-jm)^2-den1/len
+        std::vector<double> s0,s1,s2;
+    };
+
+    size_t axes;
+    double Ts;
+    size_t len;
+    size_t head;
+    std::vector<double> history;
+
+    Window speedWin;
+    Window accWin;
+
+    void configure(Window &w, const size_t len);
+    void slide(Window &w, const size_t i, const double y_old, const double y_new);
+    void sum(Window &w, const size_t i);
+
+public:
+    /**********************************************************/
+    fakeMotorEstimator();
+
+    /**
+     * Configure the estimator.
+     * @param axes the number of axes.
+     * @param Ts the sample time in [s].
+     * @param speedWin the number of samples the speeds are fitted
+     *                 over (at least 2).
+     * @param accWin the number of samples the accelerations are
+     *               fitted over (at least 3).
+     * @return true/false on success/failure.
+     */
+    bool configure(const size_t axes, const double Ts, const size_t speedWin,
+                   const size_t accWin);
+
+    /**
+     * Start over from the given positions, as if the joints had
+     * been still so far.
+     * @param pos the positions.
+     */
+    void reset(const yarp::sig::Vector &pos);
+
+    /**
+     * Account for a new sample.
+     * @param pos the positions.
+     * @param speeds the estimated speeds, of the same size.
+     * @param accels the estimated accelerations, of the same size.
+     */
+    void estimate(const yarp::sig::Vector &pos, yarp::sig::Vector &speeds,
+                  yarp::sig::Vector &accels);
+};
+
+#endif
+
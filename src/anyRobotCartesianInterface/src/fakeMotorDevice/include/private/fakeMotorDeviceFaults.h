@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICEFAULTS_H__
+#define __FAKEMOTORDEVICEFAULTS_H__
+
+#include <stddef.h>
+#include <vector>
+#include <random>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+
+/**
+ * This class degrades one link between the fake server and its
+ * clients as a real network and real sensors would do: messages
+ * get delayed by a latency plus a random jitter, dropped, held back
+ * so that later messages overtake them, and the positions carried
+ * by the states get quantized and corrupted by noise.
+ *
+ * The link is described by a list of options, e.g.:
+ * \code
+ * fault_state (latency 0.005) (jitter 0.002) (dist normal) (drop 0.01) (reorder 0.01) (quantum 0.01) (noise 0.05)
+ * \endcode
+ * where latency and jitter are in [s], dist is the distribution of
+ * the jitter (uniform within [-jitter,jitter], normal with jitter as
+ * standard deviation or exponential with jitter as mean; the delay
+ * never goes negative though), drop and reorder are
+ * probabilities, the reordered messages are held back for further
+ * hold [s] (default: twice the period) and quantum and noise (the
+ * standard deviation) are in [deg].
+ *
+ * The random generator is seeded explicitly, so that the same seed
+ * yields the same sequence of faults across runs given the same
+ * sequence of messages. Messages in flight are kept in a pool
+ * allocated upon configuration; when the pool is full they are
+ * dropped and accounted as overflows.
+ */
+class fakeMotorFaults
+{
+public:
+    /**
+     * A message in flight.
+     */
+    struct Packet
+    {
+        double            release;  // time of delivery [s]
+        double            time;     // time of dispatch [s]
+        unsigned int      seq;
+        int               tag;      // defined by the user
+        yarp::sig::Vector data;
+        bool              busy;
+    };
+
+protected:
+    enum { UNIFORM=0, NORMAL=1, EXPONENTIAL=2 };
+
+    std::mt19937 gen;
+    std::uniform_real_distribution<double> uniform;
+    std::normal_distribution<double> normal;
+
+    double latency;
+    double jitter;
+    int    dist;
+    double drop;
+    double reorder;
+    double hold;
+    double quantum;
+    double noise;
+    bool   enabled;
+
+    std::vector<Packet> pool;
+    Packet *last;
+
+    unsigned int sent;
+    unsigned int dropped;
+    unsigned int reordered;
+    unsigned int overflows;
+
+    double sampleJitter();
+
+public:
+    /**********************************************************/
+    fakeMotorFaults();
+
+    /**
+     * Configure the link.
+     * @param config the options of the link (see above).
+     * @param seed the seed of the random generator.
+     * @param len the length of the messages.
+     * @param Ts the period of the messages in [s], used to size
+     *           the pool of the messages in flight.
+     * @return true/false on success/failure.
+     */
+    bool configure(yarp::os::Searchable &config, const unsigned int seed,
+                   const size_t len, const double Ts);
+
+    /**
+     * Tell whether messages are affected by delays or losses, in
+     * which case they shall go through push() and pop().
+     */
+    bool isEnabled() const { return enabled; }
+
+    /**
+     * Send one message through the link.
+     * @param data the content of the message.
+     * @param time the time of dispatch in [s].
+     * @param seq the sequence number.
+     * @param tag a value defined by the user.
+     * @param now the current time in [s].
+     * @return false if the message has been lost.
+     */
+    bool push(const yarp::sig::Vector &data, const double time,
+              const unsigned int seq, const int tag, const double now);
+
+    /**
+     * Retrieve the next message due for delivery, in order of
+     * delivery time. The message is valid until the next call.
+     * @param now the current time in [s].
+     * @return the message or NULL if none is due.
+     */
+    const Packet *pop(const double now);
+
+    /**
+     * Quantize and add noise to the first n values in place.
+     */
+    void corrupt(yarp::sig::Vector &data, const size_t n);
+
+    /**
+     * Discard the counters.
+     */
+    void reset();
+
+    /**
+     * Dump the counters as:
+     * (sent n) (dropped n) (reordered n) (overflows n) (in_flight n)
+     */
+    void toBottle(yarp::os::Bottle &b) const;
+};
+
+#endif
+
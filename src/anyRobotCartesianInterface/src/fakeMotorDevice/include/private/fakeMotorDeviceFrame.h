@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICEFRAME_H__
+#define __FAKEMOTORDEVICEFRAME_H__
+
+#include <stddef.h>
+#include <vector>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+
+/**
+ * This class implements the compact binary format employed to
+ * stream the commands and the state between the client and the
+ * server, as an alternative to Bottle and Vector. The layout is
+ * fixed:
+ *
+ * \code
+ * int32  magic      // 'FMDF'
+ * int32  flags      // bit 0: single precision payload
+ * int32  seq        // sequence number assigned by the sender
+ * int32  ack        // sequence number of the last command applied
+ * int32  gen        // generation of the sender configuration
+ * int32  n          // number of elements
+ * n x float64 (or n x float32 when flagged)
+ * \endcode
+ *
+ * The header goes through the YARP integer encoding, whereas the
+ * payload is a packed block in the host byte order (little-endian
+ * on all the supported platforms, as the YARP encoding itself). The
+ * payload is always handed out in double precision; the single
+ * precision applies to the wire only. Once the size is settled, no
+ * further allocation takes place neither on writing nor on reading.
+ */
+class fakeMotorFrame : public yarp::os::Portable
+{
+protected:
+    yarp::sig::Vector  payload;
+    std::vector<float> buf32;
+    unsigned int       seq;
+    unsigned int       ack;
+    unsigned int       gen;
+    bool               f32;
+
+public:
+    /**
+     * The tag identifying the frame on the wire.
+     */
+    static const int MAGIC=0x46444d46;
+
+    /**
+     * The maximum number of elements accepted on reading.
+     */
+    static const int MAX_SIZE=4096;
+
+    /**********************************************************/
+    fakeMotorFrame() : seq(0), ack(0), gen(0), f32(false) { }
+
+    /**
+     * Fill the frame.
+     * @param data the elements to be sent.
+     * @param seq the sequence number.
+     * @param f32 true to send the elements in single precision.
+     */
+    void set(const yarp::sig::Vector &data, const unsigned int seq,
+             const bool f32=false);
+
+    /**
+     * Acknowledge the last command applied, which allows the
+     * receiver to correlate the state with its commands.
+     * @param ack the sequence number of the command.
+     */
+    void setAck(const unsigned int ack) { this->ack=ack; }
+
+    /**
+     * Tell the receiver the generation of the configuration of
+     * the sender, which changes whenever the limits change or the
+     * sender gets restarted.
+     * @param gen the generation.
+     */
+    void setGen(const unsigned int gen) { this->gen=gen; }
+
+    /**********************************************************/
+    const yarp::sig::Vector &get() const { return payload; }
+    unsigned int getSeq() const          { return seq;     }
+    unsigned int getAck() const          { return ack;     }
+    unsigned int getGen() const          { return gen;     }
+    bool isSinglePrecision() const       { return f32;     }
+
+    /**********************************************************/
+    bool read(yarp::os::ConnectionReader &connection);
+    bool write(yarp::os::ConnectionWriter &connection);
+};
+
+#endif
+
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICEINBOX_H__
+#define __FAKEMOTORDEVICEINBOX_H__
+
+#include <stddef.h>
+#include <vector>
+
+#include <yarp/os/all.h>
+
+/**
+ * This class is an input port that queues the incoming messages
+ * in order of arrival, as a strict BufferedPort would do, but up
+ * to a given capacity: once the queue is full the oldest message
+ * is dropped to make room for the newest one. This way the queue
+ * stays bounded even if the reader stops draining it (e.g. when
+ * the ticks stop coming in lock-step mode).
+ *
+ * The slots are allocated upon setCapacity() only.
+ */
+template <class T>
+class fakeMotorInbox : public yarp::os::BufferedPort<T>
+{
+protected:
+    yarp::os::Semaphore           guard;
+    std::vector<T>                slots;
+    std::vector<yarp::os::Stamp>  stamps;
+    size_t                        head;
+    size_t                        count;
+    unsigned int                  dropped;
+
+    /**********************************************************/
+    void onRead(T &msg)
+    {
+        yarp::os::Stamp info;
+        this->getEnvelope(info);
+
+        guard.wait();
+        if (count==slots.size())
+        {
+            head=(head+1)%slots.size();
+            count--;
+            dropped++;
+        }
+
+        size_t k=(head+count)%slots.size();
+        slots[k]=msg;
+        stamps[k]=info;
+        count++;
+        guard.post();
+    }
+
+public:
+    /**********************************************************/
+    fakeMotorInbox(const size_t capacity=1) : guard(1), head(0), count(0),
+                                              dropped(0)
+    {
+        setCapacity(capacity);
+        this->useCallback();
+    }
+
+    /**
+     * Set the maximum number of queued messages, discarding the
+     * ones queued so far.
+     */
+    void setCapacity(const size_t capacity)
+    {
+        guard.wait();
+        slots.assign(capacity>0?capacity:1,T());
+        stamps.assign(slots.size(),yarp::os::Stamp());
+        head=count=0;
+        guard.post();
+    }
+
+    /**
+     * Retrieve the oldest queued message without waiting.
+     * @param msg the message.
+     * @param info the envelope of the message.
+     * @return false if the queue is empty.
+     */
+    bool pop(T &msg, yarp::os::Stamp &info)
+    {
+        guard.wait();
+        bool ok=(count>0);
+        if (ok)
+        {
+            msg=slots[head];
+            info=stamps[head];
+            head=(head+1)%slots.size();
+            count--;
+        }
+        guard.post();
+
+        return ok;
+    }
+
+    /**
+     * Retrieve the number of messages dropped because of the
+     * queue being full since the previous call.
+     */
+    unsigned int takeDropped()
+    {
+        guard.wait();
+        unsigned int n=dropped;
+        dropped=0;
+        guard.post();
+
+        return n;
+    }
+};
+
+#endif
+
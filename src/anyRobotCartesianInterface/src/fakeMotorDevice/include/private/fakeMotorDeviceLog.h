@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICELOG_H__
+#define __FAKEMOTORDEVICELOG_H__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <yarp/sig/all.h>
+
+/**
+ * The binary log of the traffic of the fake motor device. The file
+ * is made of a header followed by records of fixed size, so that it
+ * can be mapped in memory and accessed randomly:
+ *
+ * \code
+ * header: char[4] "FMDL" | int32 version | int32 axes | int32 fields | float64 Ts [s]
+ * record: float64 time [s] | int32 kind | int32 seq | int32 session | int32 reserved |
+ *         float64[axes*fields] data
+ * \endcode
+ *
+ * The commands are recorded as applied, along with the session they
+ * belong to and their own sequence number, and fill the first axes
+ * values of the data; the states carry the tick as sequence number
+ * and -1 as session, and fill all the values (positions, speeds,
+ * accelerations). All the values are stored in the host byte order.
+ */
+class fakeMotorLog
+{
+public:
+    enum { COMMAND=0, STATE=1 };
+
+    static const int VERSION=2;
+    static const size_t HEADER_SIZE=24;
+    static const size_t PREFIX_SIZE=24;
+
+    /**********************************************************/
+    static size_t recordSize(const int axes, const int fields)
+    {
+        return PREFIX_SIZE+sizeof(double)*axes*fields;
+    }
+};
+
+/**
+ * This class appends the records to the log.
+ */
+class fakeMotorLogWriter
+{
+protected:
+    FILE *file;
+    std::vector<char> record;
+    int axes;
+    int fields;
+
+public:
+    /**********************************************************/
+    fakeMotorLogWriter();
+    ~fakeMotorLogWriter();
+
+    /**
+     * Create the log.
+     * @param name the file name.
+     * @param axes the number of axes.
+     * @param fields the number of fields of the states.
+     * @param Ts the sample time in [s].
+     * @return true/false on success/failure.
+     */
+    bool open(const std::string &name, const int axes, const int fields,
+              const double Ts);
+
+    /**
+     * Append one record.
+     * @param kind COMMAND or STATE.
+     * @param t the time of the record.
+     * @param session the session of the command (-1 for the states).
+     * @param seq the sequence number.
+     * @param data the values (the missing ones are zeroed).
+     * @return true/false on success/failure.
+     */
+    bool write(const int kind, const double t, const int session,
+               const unsigned int seq, const yarp::sig::Vector &data);
+
+    /**
+     * Flush and close the log.
+     */
+    void close();
+};
+
+/**
+ * This class maps the log in memory for reading.
+ */
+class fakeMotorLogReader
+{
+protected:
+    const char *base;
+    size_t length;
+    std::vector<char> buffer;
+    int axes;
+    int fields;
+    double Ts;
+    size_t records;
+
+public:
+    /**********************************************************/
+    fakeMotorLogReader();
+    ~fakeMotorLogReader();
+
+    /**
+     * Map the log.
+     * @param name the file name.
+     * @return true/false on success/failure.
+     */
+    bool open(const std::string &name);
+
+    /**
+     * Release the log.
+     */
+    void close();
+
+    /**********************************************************/
+    int getAxes() const    { return axes;    }
+    int getFields() const  { return fields;  }
+    double getTs() const   { return Ts;      }
+    size_t size() const    { return records; }
+
+    /**
+     * Access one record without copying it.
+     * @param i the index of the record.
+     * @param kind COMMAND or STATE.
+     * @param t the time of the record.
+     * @param session the session of the command (-1 for the states).
+     * @param seq the sequence number.
+     * @return the values, NULL if out of range.
+     */
+    const double *get(const size_t i, int &kind, double &t, int &session,
+                      unsigned int &seq) const;
+};
+
+#endif
+
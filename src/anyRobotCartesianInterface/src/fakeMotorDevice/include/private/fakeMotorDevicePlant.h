@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICEPLANT_H__
+#define __FAKEMOTORDEVICEPLANT_H__
+
+#include <stddef.h>
+#include <vector>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+
+/**
+ * This class simulates the motors of the fake part. Each joint is
+ * modeled as:
+ *
+ * P(s)=(Kp/s)*((1+Tz*s)/(1+2*Zeta*Tw*s+(Tw*s)^2))*exp(-Td*s)
+ *
+ * that is the same plant employed by the Cartesian server (see the
+ * PLANT_MODEL group in server.ini), fed with the commanded velocity
+ * whose rate of change is saturated by the reference acceleration.
+ * With the default parameters the joint reduces to a pure integrator
+ * that gives back the position when fed with the velocity; in any
+ * case the position is kept within the joint bounds.
+ *
+ * The part is described through the configuration options:
+ * \code
+ * numAxes 3
+ * axis_0  (min -180.0) (max 180.0) (init 0.0) (acc 0.0) (Kp 1.0) (Tz 0.0) (Tw 0.0) (Zeta 0.0) (Td 0.0)
+ * ...
+ * \endcode
+ * where min and max are the joint bounds in [deg], init is the
+ * starting position (default: the middle of the range), acc is the
+ * reference acceleration in [deg/s^2] (non-positive values disable
+ * the saturation) and the remaining options are the plant parameters
+ * (time constants in [s]).
+ *
+ * All the storage is allocated upon configuration, hence stepping
+ * the plant does not require any further allocation. The second
+ * order lead-lag is discretized by means of the Tustin method and
+ * the transport delay is rounded to a multiple of the sample time.
+ */
+class fakeMotorPlant
+{
+protected:
+    double Ts;
+    yarp::sig::Matrix lim;
+    yarp::sig::Vector pos;
+    yarp::sig::Vector acc;
+    yarp::sig::Vector vref;
+
+    // plant parameters and coefficients
+    yarp::sig::Vector Kp;
+    yarp::sig::Matrix num;      // (b0 b1 b2) per joint
+    yarp::sig::Matrix den;      // (a1 a2) per joint
+    std::vector<bool> bypass;
+
+    // filters state
+    yarp::sig::Matrix u_old;    // (u[k-1] u[k-2]) per joint
+    yarp::sig::Matrix y_old;    // (y[k-1] y[k-2]) per joint
+    yarp::sig::Vector vel_old;
+
+    // transport delay lines
+    yarp::sig::Matrix line;
+    std::vector<size_t> delay;
+    size_t head;
+
+    bool configureDynamics(const int j, yarp::os::Searchable &axis);
+
+public:
+    fakeMotorPlant();
+
+    /**
+     * Configure the plant.
+     * @param config the part description; if "numAxes" is missing,
+     *               a part of three joints is simulated.
+     * @param Ts the sample time in [s].
+     * @return true/false on success/failure.
+     */
+    bool configure(yarp::os::Searchable &config, const double Ts);
+
+    /**
+     * Advance the plant of one sample time.
+     * @param vel the commanded joints velocities in [deg/s].
+     */
+    void step(const yarp::sig::Vector &vel);
+
+    /**
+     * Set the reference acceleration of one joint.
+     * @param j the joint.
+     * @param acc the acceleration in [deg/s^2]; non-positive
+     *            values disable the saturation.
+     * @return true/false on success/failure.
+     */
+    bool setRefAcceleration(const int j, const double acc);
+
+    /**
+     * Overwrite the position of one joint, which is kept within
+     * the joint bounds anyway.
+     * @param j the joint.
+     * @param val the new position in [deg].
+     * @return true/false on success/failure.
+     */
+    bool set(const int j, const double val);
+
+    /**
+     * Change the bounds of one joint, moving the joint within
+     * them if needed.
+     * @param j the joint.
+     * @param min the lower bound in [deg].
+     * @param max the upper bound in [deg].
+     * @return true/false on success/failure.
+     */
+    bool setLim(const int j, const double min, const double max);
+
+    /**********************************************************/
+    size_t getAxes() const                  { return pos.length(); }
+    const yarp::sig::Vector &get() const    { return pos;          }
+    const yarp::sig::Matrix &getLim() const { return lim;          }
+    const yarp::sig::Vector &getAcc() const { return acc;          }
+    double getTs() const                    { return Ts;           }
+};
+
+#endif
+
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICESESSIONS_H__
+#define __FAKEMOTORDEVICESESSIONS_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+
+#include "fakeMotorDeviceFrame.h"
+#include "fakeMotorDeviceInbox.h"
+
+/**
+ * One source of commands: the default one is fed through the
+ * cmd:i ports and the rpc, the others are opened on request.
+ */
+struct fakeMotorSession
+{
+    std::string name;
+    int id;
+    int priority;
+    std::vector<bool> mask;
+    fakeMotorInbox<yarp::os::Bottle> *cmdPort;
+    fakeMotorInbox<fakeMotorFrame>   *cmdBinPort;
+    yarp::sig::Vector sp;
+    double lastCmdTime;
+    yarp::sig::Vector next;
+    double nextTime;
+    unsigned int nextSeq;
+    int nextFlags;
+    bool pending;
+    bool active;
+    bool applied;
+    unsigned int lastSeq;
+    unsigned int cmds;
+    unsigned int lost;
+    unsigned int rateCount;
+    double rateTime;
+    double rate;
+
+    /**
+     * Reset the session.
+     */
+    void init(const std::string &name, const int id, const int priority,
+              const std::vector<bool> &mask);
+
+    /**
+     * Dump the description of the session as:
+     * (name s) (id n) (priority n) (joints j0 j1 ...) (active 0|1)
+     * (commands n) (lost n) (rate r)
+     */
+    void toBottle(yarp::os::Bottle &b) const;
+};
+
+/**
+ * This class keeps the sessions of commands of the fake server
+ * and arbitrates among them: each joint gets the setpoint of the
+ * active session with the highest priority among those allowed to
+ * command it (the most recent command breaks the ties), whereas
+ * the joints left alone are stopped.
+ *
+ * The sessions other than the default one come with their own
+ * command ports <prefix>/<name>/cmd:i and <prefix>/<name>/cmd_bin:i
+ * unless they are meant for in-process clients. The list is guarded
+ * by the mutex of the server, which is acquired by open(), close()
+ * and respond() only, since the ports are opened and closed out of
+ * the critical section not to hold the server thread up; all the
+ * other methods are to be called with the mutex held.
+ */
+class fakeMotorSessions
+{
+protected:
+    yarp::os::Semaphore &mutex;
+    fakeMotorSession defaultSession;
+    std::vector<fakeMotorSession*> sessions;
+    std::string prefix;
+    size_t queue;
+    int ids;
+
+    void release(fakeMotorSession *s);
+
+public:
+    /**
+     * Constructor.
+     * @param mutex the mutex of the server.
+     */
+    fakeMotorSessions(yarp::os::Semaphore &mutex);
+
+    /**
+     * Set up the default session, which covers all the joints.
+     * @param prefix the prefix of the ports of the sessions.
+     * @param axes the number of axes.
+     * @param queue the capacity of the command ports.
+     * @param cmdPort, cmdBinPort the command ports of the server.
+     */
+    void configure(const std::string &prefix, const size_t axes, const size_t queue,
+                   fakeMotorInbox<yarp::os::Bottle> *cmdPort,
+                   fakeMotorInbox<fakeMotorFrame> *cmdBinPort);
+
+    /**
+     * Open a session. Not to be called with the mutex held.
+     * @param name the unique name of the session.
+     * @param priority the priority; the default session has 0.
+     * @param joints the joints the session is allowed to command;
+     *               if empty, all of them.
+     * @param ports true to open the command ports.
+     * @return the id of the session or -1 on failure.
+     */
+    int open(const std::string &name, const int priority,
+             const std::vector<int> &joints, const bool ports=true);
+
+    /**
+     * Close a session. Not to be called with the mutex held.
+     * @param name the name of the session.
+     * @param vel the velocities to be arbitrated again.
+     * @return true/false on success/failure.
+     */
+    bool close(const std::string &name, yarp::sig::Vector &vel);
+
+    /**
+     * Close all the sessions but the default one.
+     */
+    void clear();
+
+    /**********************************************************/
+    size_t size() const                             { return sessions.size();   }
+    fakeMotorSession &operator[](const size_t k)    { return *sessions[k];      }
+    fakeMotorSession &getDefault()                  { return defaultSession;    }
+    bool isDefault(const fakeMotorSession &s) const { return (&s==&defaultSession); }
+
+    /**
+     * Retrieve the session with the given id or name.
+     * @return the session or NULL if not found.
+     */
+    fakeMotorSession *find(const int id);
+    fakeMotorSession *find(const std::string &name);
+
+    /**
+     * Assign each joint the setpoint of the session in charge of it.
+     * @param vel the velocities.
+     */
+    void arbitrate(yarp::sig::Vector &vel) const;
+
+    /**
+     * Serve the rpc requests concerning the sessions:
+     * [sess] [open] <name> <priority> (<joints>)
+     * [sess] [close] <name>
+     * [sess] [list]
+     * @param vel the velocities to be arbitrated upon closing.
+     */
+    void respond(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply,
+                 yarp::sig::Vector &vel);
+
+    /**
+     * Dump the description of all the sessions.
+     */
+    void toBottle(yarp::os::Bottle &b) const;
+};
+
+#endif
+
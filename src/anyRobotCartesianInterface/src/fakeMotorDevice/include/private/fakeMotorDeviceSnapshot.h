@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICESNAPSHOT_H__
+#define __FAKEMOTORDEVICESNAPSHOT_H__
+
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+
+/**
+ * This class holds the latest encoders state received from the
+ * server and shares it between one writer and many readers by
+ * means of a sequence lock: the writer never blocks, whereas the
+ * readers retry only when they happen to overlap with a write.
+ *
+ * The state is made of one or more fields of size() elements each,
+ * namely the positions, the speeds and the accelerations of the
+ * axes, laid out one after the other.
+ *
+ * The payload is made of relaxed atomics so that torn reads are
+ * well defined and get simply discarded by the sequence check.
+ *
+ * The samples are also counted, so that a reader can wait for the
+ * motion rather than polling (see waitMotion()).
+ */
+class fakeMotorStateSnapshot;
+
+
+/**
+ * This class holds the reader-side state of the wait for the
+ * motion: each reader owns its own watch, thus the readers do not
+ * steal the motion from each other and every reader applies its own
+ * threshold.
+ */
+class fakeMotorMotionWatch
+{
+protected:
+    std::vector<double> ref;
+    std::vector<double> pos;
+    double threshold;
+    unsigned int samples;
+    bool init;
+
+    friend class fakeMotorStateSnapshot;
+
+public:
+    /**********************************************************/
+    fakeMotorMotionWatch() : threshold(0.0), samples(0), init(false) { }
+
+    /**
+     * Set the displacement in [deg] beyond which an axis is deemed
+     * moving (0.0 by default, i.e. any change).
+     */
+    void setThreshold(const double threshold) { this->threshold=threshold; }
+};
+
+
+/**********************************************************/
+class fakeMotorStateSnapshot
+{
+protected:
+    std::atomic<unsigned int>  seq;
+    std::atomic<double>       *data;
+    std::atomic<double>        stampTime;
+    std::atomic<double>        rxTime;
+    std::atomic<size_t>        avail;
+    size_t                     axes;
+    size_t                     fields;
+
+    // samples notification
+    std::atomic<unsigned int>       samples;
+    mutable std::atomic<int>        waiters;
+    mutable std::mutex              eventMutex;
+    mutable std::condition_variable event;
+
+    // writer-side only
+    double lastStampTime;
+
+public:
+    /**
+     * The fields of the state.
+     */
+    enum { POSITION=0, SPEED=1, ACCELERATION=2 };
+
+    /**********************************************************/
+    fakeMotorStateSnapshot() : seq(0), data(NULL), stampTime(0.0),
+                               rxTime(0.0), avail(0), axes(0), fields(0),
+                               samples(0), waiters(0),
+                               lastStampTime(-1.0) { }
+
+    /**********************************************************/
+    ~fakeMotorStateSnapshot()
+    {
+        delete[] data;
+    }
+
+    /**
+     * Allocate room for the given number of axes. It is not
+     * thread-safe and shall be called before any read or write.
+     * @param axes the number of axes.
+     * @param fields the number of fields.
+     */
+    void resize(const size_t axes, const size_t fields=1)
+    {
+        delete[] data;
+        data=new std::atomic<double>[axes*fields];
+        for (size_t i=0; i<axes*fields; i++)
+            data[i].store(0.0,std::memory_order_relaxed);
+
+        this->axes=axes;
+        this->fields=fields;
+        avail.store(0,std::memory_order_relaxed);
+        lastStampTime=-1.0;
+        seq.store(0,std::memory_order_release);
+    }
+
+    /**********************************************************/
+    size_t size() const { return axes; }
+
+    /**
+     * Tell whether at least one sample has been written.
+     */
+    bool isAvailable() const { return (seq.load(std::memory_order_acquire)!=0); }
+
+    /**
+     * Publish a new sample. Samples of the wrong size as well as
+     * those delivered out of order (stamp older than the latest
+     * one) are discarded.
+     * @param data the values, that is the positions optionally
+     *             followed by the further fields.
+     * @param stamp the envelope attached by the server.
+     * @param rxTime the local reception time.
+     * @return true iff the sample has been published.
+     */
+    bool write(const yarp::sig::Vector &data, const yarp::os::Stamp &stamp,
+               const double rxTime)
+    {
+        size_t len=(size_t)data.length();
+        if ((axes==0) || (len%axes!=0) || (len>axes*fields))
+            return false;
+
+        double t=(stamp.isValid()?stamp.getTime():rxTime);
+        if (stamp.isValid() && (t<lastStampTime))
+            return false;
+
+        lastStampTime=t;
+
+        unsigned int s=seq.load(std::memory_order_relaxed);
+        seq.store(s+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i=0; i<len; i++)
+            this->data[i].store(data[i],std::memory_order_relaxed);
+        avail.store(len/axes,std::memory_order_relaxed);
+        stampTime.store(t,std::memory_order_relaxed);
+        this->rxTime.store(rxTime,std::memory_order_relaxed);
+
+        // zero is reserved to flag that nothing has been written yet
+        seq.store((s+2!=0)?s+2:2,std::memory_order_release);
+
+        // the lock is taken only when somebody is waiting, just to
+        // make sure that the notification does not get lost
+        samples.fetch_add(1);
+        if (waiters.load()>0)
+        {
+            { std::lock_guard<std::mutex> lck(eventMutex); }
+            event.notify_all();
+        }
+
+        return true;
+    }
+
+    /**
+     * Wait for a sample in which the positions of the axes have
+     * moved by more than the threshold of the watch with respect to
+     * the sample that ended the previous wait (the first call returns
+     * as soon as a sample is available). Many readers may wait at
+     * the same time, each with its own watch.
+     * @param watch the reader-side state, updated upon return.
+     * @param timeout the maximum wait in [s].
+     * @return true if the axes have moved, false upon timeout.
+     */
+    bool waitMotion(fakeMotorMotionWatch &watch, const double timeout) const
+    {
+        if (axes==0)
+            return false;
+
+        if (watch.ref.size()!=axes)
+        {
+            watch.ref.assign(axes,0.0);
+            watch.pos.assign(axes,0.0);
+            watch.init=false;
+        }
+
+        std::chrono::steady_clock::time_point deadline=std::chrono::steady_clock::now()+
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+
+        for (;;)
+        {
+            unsigned int s=samples.load();
+            if (s!=watch.samples)
+            {
+                watch.samples=s;
+
+                double stampTime,rxTime;
+                if (read(POSITION,&watch.pos[0],stampTime,rxTime))
+                {
+                    bool moved=!watch.init;
+                    for (size_t i=0; i<axes; i++)
+                        moved|=(fabs(watch.pos[i]-watch.ref[i])>watch.threshold);
+
+                    if (moved)
+                    {
+                        watch.ref.swap(watch.pos);
+                        watch.init=true;
+                        return true;
+                    }
+                }
+            }
+
+            std::unique_lock<std::mutex> lck(eventMutex);
+            waiters.fetch_add(1);
+            bool notified=event.wait_until(lck,deadline,[&]{ return (samples.load()!=s); });
+            waiters.fetch_sub(1);
+
+            if (!notified)
+                return false;
+        }
+    }
+
+    /**
+     * Retrieve a consistent copy of one field of the latest sample.
+     * @param field the field.
+     * @param dst the destination array of size() elements.
+     * @param stampTime the server time of the sample.
+     * @param rxTime the local reception time of the sample.
+     * @return false if no sample carrying the field has been
+     *         published yet.
+     */
+    bool read(const size_t field, double *dst, double &stampTime, double &rxTime) const
+    {
+        for (;;)
+        {
+            unsigned int s0=seq.load(std::memory_order_acquire);
+            if (s0==0)
+                return false;
+            else if (s0&0x01)
+                continue;
+
+            size_t n=avail.load(std::memory_order_relaxed);
+            if (field<n)
+                for (size_t i=0; i<axes; i++)
+                    dst[i]=data[field*axes+i].load(std::memory_order_relaxed);
+            stampTime=this->stampTime.load(std::memory_order_relaxed);
+            rxTime=this->rxTime.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed)==s0)
+                return (field<n);
+        }
+    }
+
+    /**
+     * Retrieve a consistent copy of one field of one single axis
+     * of the latest sample.
+     * @param field the field.
+     * @param j the axis.
+     * @param val the value.
+     * @param stampTime the server time of the sample.
+     * @param rxTime the local reception time of the sample.
+     * @return false if no sample carrying the field has been
+     *         published yet or the axis is out of range.
+     */
+    bool read(const size_t field, const size_t j, double &val, double &stampTime,
+              double &rxTime) const
+    {
+        if (j>=axes)
+            return false;
+
+        for (;;)
+        {
+            unsigned int s0=seq.load(std::memory_order_acquire);
+            if (s0==0)
+                return false;
+            else if (s0&0x01)
+                continue;
+
+            size_t n=avail.load(std::memory_order_relaxed);
+            if (field<n)
+                val=data[field*axes+j].load(std::memory_order_relaxed);
+            stampTime=this->stampTime.load(std::memory_order_relaxed);
+            rxTime=this->rxTime.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed)==s0)
+                return (field<n);
+        }
+    }
+
+    /**
+     * Retrieve a consistent copy of the latest positions.
+     */
+    bool read(double *encs, double &stampTime, double &rxTime) const
+    {
+        return read(POSITION,encs,stampTime,rxTime);
+    }
+
+    /**
+     * Retrieve a consistent copy of the latest position of one axis.
+     */
+    bool read(const size_t j, double &enc, double &stampTime, double &rxTime) const
+    {
+        return read(POSITION,j,enc,stampTime,rxTime);
+    }
+};
+
+#endif
+
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEMOTORDEVICESTATS_H__
+#define __FAKEMOTORDEVICESTATS_H__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <yarp/os/all.h>
+
+/**
+ * This class collects the samples of one quantity within a
+ * histogram of fixed bins, along with the usual statistics.
+ * The storage is allocated upon configuration only.
+ */
+class fakeMotorHistogram
+{
+protected:
+    double lo;
+    double width;
+    std::vector<unsigned int> bins;
+    unsigned int under;
+    unsigned int over;
+    unsigned int count;
+    double sum;
+    double min;
+    double max;
+
+public:
+    /**********************************************************/
+    fakeMotorHistogram();
+
+    /**
+     * Configure the histogram.
+     * @param lo the lower bound of the first bin.
+     * @param hi the upper bound of the last bin.
+     * @param n the number of bins.
+     */
+    void configure(const double lo, const double hi, const size_t n);
+
+    /**
+     * Account for a new sample.
+     */
+    void add(const double x);
+
+    /**
+     * Discard all the samples.
+     */
+    void reset();
+
+    /**
+     * Estimate the given percentile from the bins.
+     * @param p the percentile in [0,1].
+     */
+    double percentile(const double p) const;
+
+    /**********************************************************/
+    unsigned int getCount() const { return count; }
+
+    /**
+     * Dump the histogram as:
+     * (count n) (mean m) (min m) (max m) (p50 p) (p99 p) (under u)
+     * (over o) (lo l) (width w) (bins b_0 ... b_n-1)
+     */
+    void toBottle(yarp::os::Bottle &b) const;
+};
+
+/**
+ * This class gathers the timing statistics of the server loop.
+ * Times are in [ms].
+ */
+class fakeMotorStats
+{
+protected:
+    double Ts;
+    double tolerance;
+    double lastTick;
+
+    fakeMotorHistogram period;
+    fakeMotorHistogram runTime;
+    fakeMotorHistogram latency;
+
+    unsigned int ticks;
+    unsigned int late;
+    unsigned int overruns;
+    unsigned int cmds;
+    unsigned int lost;
+    unsigned int lastSeq;
+    unsigned int events[5];
+
+public:
+    /**
+     * The events occurring to the commands: superseded by a newer
+     * one, discarded for being too old, applied later than one
+     * period after dispatch, joints stopped for lack of commands,
+     * dropped for the queue of the port being full.
+     */
+    enum { COALESCED=0, STALE=1, LATE=2, TIMEOUT=3, DROPPED=4 };
+
+    /**********************************************************/
+    fakeMotorStats();
+
+    /**
+     * Configure the statistics.
+     * @param Ts the nominal period in [ms].
+     * @param bins the number of bins of the histograms.
+     * @param tolerance the fraction of Ts beyond which a tick is
+     *                  deemed late.
+     */
+    void configure(const double Ts, const size_t bins, const double tolerance);
+
+    /**
+     * Account for one tick.
+     * @param t0 the time the tick began in [s].
+     * @param t1 the time the tick ended in [s].
+     */
+    void addTick(const double t0, const double t1);
+
+    /**
+     * Account for one command.
+     * @param seq the sequence number given by the client, whose
+     *            gaps tell the commands lost on the way.
+     */
+    void addCommand(const unsigned int seq);
+
+    /**
+     * Account for one command carrying no sequence number.
+     */
+    void addCommand();
+
+    /**
+     * Account for the time elapsed from the dispatch of a command
+     * to the publication of the state it produced.
+     * @param dt the latency in [s].
+     */
+    void addLatency(const double dt);
+
+    /**
+     * Account for one or more events occurring to the commands.
+     */
+    void count(const int event, const unsigned int n=1);
+
+    /**
+     * Discard all the statistics.
+     */
+    void reset();
+
+    /**
+     * Dump the statistics as:
+     * (ticks n) (late n) (overruns n) (commands n) (lost n)
+     * (coalesced n) (stale n) (late_commands n) (timeouts n) (dropped n)
+     * (period ...) (run ...) (latency ...)
+     */
+    void toBottle(yarp::os::Bottle &b) const;
+};
+
+#endif
+
@@ -18,6 +18,7 @@
 #include <fakeMotorDevice.h>
 #include <private/fakeMotorDeviceComponents.h>
 
+using namespace yarp::os;
 using namespace yarp::dev;
 
 /**********************************************************/
@@ -35,5 +36,18 @@ void registerFakeMotorDevices()
     Drivers::factory().add(factoryClient);
 }
 
+/**********************************************************/
+void publishFakeMotorClock(BufferedPort<Bottle> &port, const double t)
+{
+    if (port.getOutputCount()>0)
+    {
+        Bottle &clk=port.prepare();
+        clk.clear();
+        clk.addInt((int)t);
+        clk.addInt((int)(1e9*(t-(int)t)));
+        port.writeStrict();
+    }
+}
+
 
 
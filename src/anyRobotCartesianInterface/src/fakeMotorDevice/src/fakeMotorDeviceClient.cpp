@@ -28,8 +28,27 @@ using namespace yarp::sig;
 /**********************************************************/
 fakeMotorDeviceClient::fakeMotorDeviceClient()
 {
+    peer=NULL;
+    sessionId=0;
+    rpcTimeout=1.0;
+    rpcId=0;
+    rpcChannel=0;
+    pipelined=false;
+    axesCache=0;
+    cacheGen=0;
+    cacheValid=false;
+    remoteGen=0;
+    cmdSeq=0;
+    timeout=0.0;
+    syncWatchdog=0.02;
+    stateSync=false;
+    binary=false;
+    f32=false;
+    lockstep=false;
     configured=false;
     statePort.setOwner(this);
+    stateBinPort.setOwner(this);
+    rpcReplyPort.setOwner(this);
 }
 
 /**********************************************************/
@@ -40,31 +59,257 @@ bool fakeMotorDeviceClient::open(Searchable &config)
     string remote=config.check("remote",Value("/fakeyServer")).asString().c_str();
     string local=config.check("local",Value("/fakeyClient")).asString().c_str();
 
-    statePort.open((local+"/state:i").c_str());
-    cmdPort.open((local+"/cmd:o").c_str());
+    // encoders older than this timeout [s] are not delivered
+    // to the caller; non-positive values disable the check
+    timeout=config.check("state_timeout",Value(0.0)).asDouble();
+
+    // in state-sync mode the reads of all the encoders issued by
+    // the control thread wait for a state in which the axes moved by
+    // more than the threshold [deg] or for the watchdog [s] at most:
+    // the control thread of the Cartesian server is thus paced by the
+    // motion of the robot rather than by its own period, while it
+    // slows down to the watchdog when the robot is idle; the control
+    // thread is the first thread other than the opener that reads
+    // the encoders and it keeps the role until the device is closed
+    syncOpener=this_thread::get_id();
+    syncOwner=thread::id();
+    stateSync=(config.check("state_sync",Value("off")).asString()=="on");
+    syncWatchdog=config.check("state_sync_watchdog",Value(0.02)).asDouble();
+    syncWatch.setThreshold(config.check("state_sync_threshold",Value(0.0)).asDouble());
+
+    // in lock-step mode the client is also allowed
+    // to advance the plant through the tick port
+    lockstep=(config.check("lockstep",Value("off")).asString()=="on");
+
+    // the streaming format: "binary" (default) and "binary32" resort
+    // to the compact frames (the latter in single precision), whereas
+    // "bottle" sticks to Bottle and Vector
+    string wire=config.check("wire",Value("binary")).asString().c_str();
+    f32=(wire=="binary32");
+
+    // the carrier of the streams: "udp" (default), "tcp", "shmem"
+    // (to be preferred when the server runs on the same host) or
+    // "inproc", which bypasses the network altogether when the
+    // server lives within the same process; the rpc goes through
+    // tcp unless the shared memory is selected
+    string carrier=config.check("carrier",Value("udp")).asString().c_str();
+    string rpcCarrier=(carrier=="shmem")?"shmem":"tcp";
+
+    // the commands might go through a session of their own, which
+    // lets the server arbitrate among many clients driving the same
+    // part: the session with the highest priority drives the joints
+    // it is given (all of them by default)
+    session=config.check("session",Value("")).asString().c_str();
+    int priority=config.check("priority",Value(1)).asInt();
+    vector<int> joints;
+    if (Bottle *list=config.find("joints").asList())
+        for (int i=0; i<list->size(); i++)
+            joints.push_back(list->get(i).asInt());
+
+    if (carrier=="inproc")
+        return openInProcess(remote,priority,joints);
+
+    // with the "pipelined" rpc (default) many requests can be in
+    // flight at once, whereas "blocking" waits for each reply;
+    // replies are awaited for rpc_timeout [s] at most
+    pipelined=(config.check("rpc_mode",Value("pipelined")).asString()=="pipelined");
+    rpcTimeout=config.check("rpc_timeout",Value(1.0)).asDouble();
+
+    // retrieve the number of axes once for all to size
+    // the state snapshot before the stream gets connected
     rpcPort.open((local+"/rpc").c_str());
-    
+    if (Network::connect(rpcPort.getName().c_str(),(remote+"/rpc").c_str(),rpcCarrier.c_str()))
+    {
+        configured=true;
+
+        int axes;
+        configured=getAxes(&axes);
+        if (configured)
+        {
+            snapshot.resize(axes,3);
+            vel.resize(axes,0.0);
+        }
+    }
+
+    if (!configured)
+    {
+        rpcPort.close();
+
+        printf("Fake Motor Device Client failed to open\n");
+        return false;
+    }
+
+    // fall back on Bottle and Vector whenever
+    // the server does not support the binary format
+    binary=(wire!="bottle") && negotiateBinary();
+
+    // fall back on the blocking rpc whenever
+    // the server does not support the pipelined one;
+    // the replies come through a port the server
+    // opens for this client only
+    if (pipelined)
+    {
+        rpcAsyncPort.open((local+"/rpc_async:o").c_str());
+        rpcReplyPort.open((local+"/rpc_async:i").c_str());
+        rpcAsyncPort.setStrict();
+
+        Bottle cmd,reply;
+        cmd.addVocab(Vocab::encode("rpc"));
+        cmd.addVocab(Vocab::encode("open"));
+        pipelined=Network::connect(rpcAsyncPort.getName().c_str(),(remote+"/rpc_async:i").c_str(),rpcCarrier.c_str()) &&
+                  rpcPort.write(cmd,reply) && (reply.get(0).asVocab()==Vocab::encode("ack"));
+
+        if (pipelined)
+        {
+            rpcChannel=reply.get(1).asInt();
+            pipelined=Network::connect(reply.get(2).asString().c_str(),rpcReplyPort.getName().c_str(),rpcCarrier.c_str());
+        }
+
+        if (!pipelined)
+        {
+            closeChannel();
+            rpcAsyncPort.close();
+            rpcReplyPort.close();
+        }
+    }
+
     bool ok=true;
-    ok&=Network::connect((remote+"/state:o").c_str(),statePort.getName().c_str(),"udp");
-    ok&=Network::connect(cmdPort.getName().c_str(),(remote+"/cmd:i").c_str(),"udp");
-    ok&=Network::connect(rpcPort.getName().c_str(),(remote+"/rpc").c_str(),"tcp");
+    string cmdRemote=remote;
+    if (!session.empty())
+    {
+        Bottle cmd;
+        cmd.addVocab(Vocab::encode("sess"));
+        cmd.addVocab(Vocab::encode("open"));
+        cmd.addString(session.c_str());
+        cmd.addInt(priority);
+        Bottle &list=cmd.addList();
+        for (size_t i=0; i<joints.size(); i++)
+            list.addInt(joints[i]);
+
+        if (sendCommand(cmd))
+            cmdRemote=remote+"/"+session;
+        else
+        {
+            printf("Unable to open the session \"%s\"\n",session.c_str());
+            session.clear();
+            ok=false;
+        }
+    }
+
+    if (binary)
+    {
+        stateBinPort.open((local+"/state:i").c_str());
+        cmdBinPort.open((local+"/cmd:o").c_str());
+
+        ok&=Network::connect((remote+(f32?"/state_bin32:o":"/state_bin:o")).c_str(),stateBinPort.getName().c_str(),carrier.c_str());
+        ok&=Network::connect(cmdBinPort.getName().c_str(),(cmdRemote+"/cmd_bin:i").c_str(),carrier.c_str());
+    }
+    else
+    {
+        statePort.open((local+"/state:i").c_str());
+        cmdPort.open((local+"/cmd:o").c_str());
+
+        ok&=Network::connect((remote+"/state_ext:o").c_str(),statePort.getName().c_str(),carrier.c_str());
+        ok&=Network::connect(cmdPort.getName().c_str(),(cmdRemote+"/cmd:i").c_str(),carrier.c_str());
+    }
+
+    if (lockstep)
+    {
+        tickPort.open((local+"/tick:o").c_str());
+        ok&=Network::connect(tickPort.getName().c_str(),(remote+"/tick:i").c_str(),rpcCarrier.c_str());
+    }
 
     if (ok)
     {
-        configured=true;
+        // the server publishes its state only upon ticks, which in
+        // lock-step mode might not come before the first read, hence
+        // the latest state is requested for the streams just connected
+        Bottle cmd;
+        cmd.addVocab(Vocab::encode("enc"));
+        cmd.addVocab(Vocab::encode("pub"));
+        sendCommand(cmd);
+
+        // give the state stream the chance to deliver the first sample
+        for (double t0=Time::now(); Time::now()-t0<1.0; Time::delay(0.01))
+            if (snapshot.isAvailable())
+                break;
+
+        // the configuration is fetched in advance
+        // since the binary state tells when it changes
+        if (binary)
+        {
+            cacheMutex.wait();
+            refreshCache();
+            cacheMutex.post();
+        }
 
         printf("Fake Motor Device Client successfully open\n");
         return true;
     }
     else
     {
+        closeSession();
+        closeChannel();
+
         statePort.close();
         cmdPort.close();
+        stateBinPort.close();
+        cmdBinPort.close();
+        rpcAsyncPort.close();
+        rpcReplyPort.close();
         rpcPort.close();
+        tickPort.close();
+        configured=false;
+
+        printf("Fake Motor Device Client failed to open\n");
+        return false;
+    }
+}
 
+/**********************************************************/
+bool fakeMotorDeviceClient::openInProcess(const string &remote, const int priority,
+                                          const vector<int> &joints)
+{
+    peer=fakeMotorDeviceServer::attach(remote);
+    if (peer==NULL)
+    {
+        printf("No server \"%s\" within this process\n",remote.c_str());
         printf("Fake Motor Device Client failed to open\n");
         return false;
     }
+
+    // without a session of its own the client
+    // commands through the default one
+    sessionId=0;
+    if (!session.empty())
+    {
+        sessionId=peer->openSession(session,priority,joints,false);
+        if (sessionId<0)
+        {
+            printf("Unable to open the session \"%s\"\n",session.c_str());
+            printf("Fake Motor Device Client failed to open\n");
+            session.clear();
+            sessionId=0;
+            peer->detach();
+            peer=NULL;
+            return false;
+        }
+    }
+
+    configured=true;
+
+    int axes;
+    peer->getAxes(&axes);
+    vel.resize(axes,0.0);
+
+    // the state is shared with the server that
+    // publishes it at the next sample time
+    for (double t0=Time::now(); Time::now()-t0<1.0; Time::delay(0.01))
+        if (getSnapshot().isAvailable())
+            break;
+
+    printf("Fake Motor Device Client successfully open (in-process)\n");
+    return true;
 }
 
 /**********************************************************/
@@ -72,26 +317,233 @@ bool fakeMotorDeviceClient::close()
 {
     printf("Closing Fake Motor Device Client ...\n");
 
+    closeSession();
+    closeChannel();
+
+    if (peer!=NULL)
+    {
+        peer->detach();
+        peer=NULL;
+    }
+
     statePort.interrupt();
     cmdPort.interrupt();
+    stateBinPort.interrupt();
+    cmdBinPort.interrupt();
+    rpcAsyncPort.interrupt();
+    rpcReplyPort.interrupt();
     rpcPort.interrupt();
+    tickPort.interrupt();
 
     statePort.close();
     cmdPort.close();
+    stateBinPort.close();
+    cmdBinPort.close();
+    rpcAsyncPort.close();
+    rpcReplyPort.close();
     rpcPort.close();
+    tickPort.close();
+
+    // release whoever is still waiting for a reply
+    rpcMutex.wait();
+    for (map<unsigned int,PendingCall*>::iterator it=pendingCalls.begin(); it!=pendingCalls.end(); it++)
+        it->second->done.post();
+    rpcMutex.post();
 
     configured=false;
+    pipelined=false;
+    cacheValid=false;
 
     printf("Fake Motor Device Client successfully closed\n");
     return true;
 }
 
+/**********************************************************/
+void fakeMotorDeviceClient::closeSession()
+{
+    if (session.empty())
+        return;
+
+    if (peer!=NULL)
+        peer->closeSession(session);
+    else
+    {
+        Bottle cmd;
+        cmd.addVocab(Vocab::encode("sess"));
+        cmd.addVocab(Vocab::encode("close"));
+        cmd.addString(session.c_str());
+        sendCommand(cmd);
+    }
+
+    session.clear();
+    sessionId=0;
+}
+
+/**********************************************************/
+void fakeMotorDeviceClient::closeChannel()
+{
+    if (rpcChannel==0)
+        return;
+
+    Bottle cmd,reply;
+    cmd.addVocab(Vocab::encode("rpc"));
+    cmd.addVocab(Vocab::encode("close"));
+    cmd.addInt(rpcChannel);
+    rpcPort.write(cmd,reply);
+
+    rpcChannel=0;
+}
+
+/**********************************************************/
+void fakeMotorDeviceClient::onRpcReply(Bottle &reply)
+{
+    // the reply port is fed by the channel of this client only
+    rpcMutex.wait();
+    map<unsigned int,PendingCall*>::iterator it=pendingCalls.find((unsigned int)reply.get(1).asInt());
+    if (it!=pendingCalls.end())
+    {
+        it->second->reply=reply.tail().tail();
+        it->second->done.post();
+    }
+    rpcMutex.post();
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::call(deque<Bottle> &cmds, deque<Bottle> &replies)
+{
+    replies.assign(cmds.size(),Bottle());
+
+    if (!pipelined)
+    {
+        for (size_t i=0; i<cmds.size(); i++)
+            if (!rpcPort.write(cmds[i],replies[i]))
+                return false;
+
+        return true;
+    }
+
+    // issue all the requests tagged with their ids ...
+    deque<unsigned int> ids;
+    rpcMutex.wait();
+    for (size_t i=0; i<cmds.size(); i++)
+    {
+        // the ids wrap around modulo 2^32 skipping zero, hence
+        // they are unique as long as the requests in flight are
+        // fewer than that; they travel as their 32-bit pattern
+        if (++rpcId==0)
+            rpcId=1;
+
+        unsigned int id=rpcId;
+        pendingCalls[id]=new PendingCall;
+        ids.push_back(id);
+
+        Bottle &req=rpcAsyncPort.prepare();
+        req.clear();
+        req.addInt(rpcChannel);
+        req.addInt((int)id);
+        req.append(cmds[i]);
+        rpcAsyncPort.writeStrict();
+    }
+    rpcMutex.post();
+
+    // ... and then collect the replies
+    bool ok=true;
+    double t0=Time::now();
+    for (size_t i=0; i<ids.size(); i++)
+    {
+        rpcMutex.wait();
+        PendingCall *pending=pendingCalls[ids[i]];
+        rpcMutex.post();
+
+        double timeout=rpcTimeout-(Time::now()-t0);
+        ok&=(timeout>0.0) && pending->done.waitWithTimeout(timeout);
+
+        rpcMutex.wait();
+        replies[i]=pending->reply;
+        pendingCalls.erase(ids[i]);
+        delete pending;
+        rpcMutex.post();
+    }
+
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::refreshCache()
+{
+    int axes=(int)vel.length();
+
+    deque<Bottle> cmds,replies;
+    Bottle cmd;
+    cmd.addVocab(Vocab::encode("sim"));
+    cmd.addVocab(Vocab::encode("gen"));
+    cmds.push_back(cmd);
+
+    cmd.clear();
+    cmd.addVocab(Vocab::encode("enc"));
+    cmd.addVocab(Vocab::encode("axes"));
+    cmds.push_back(cmd);
+
+    for (int i=0; i<axes; i++)
+    {
+        cmd.clear();
+        cmd.addVocab(Vocab::encode("lim"));
+        cmd.addVocab(Vocab::encode("get"));
+        cmd.addInt(i);
+        cmds.push_back(cmd);
+    }
+
+    cacheValid=false;
+    if (!call(cmds,replies))
+        return false;
+
+    for (size_t i=0; i<replies.size(); i++)
+        if (replies[i].get(0).asVocab()!=Vocab::encode("ack"))
+            return false;
+
+    cacheGen=(unsigned int)replies[0].get(1).asInt();
+    axesCache=replies[1].get(1).asInt();
+    if (axesCache!=axes)
+        printf("Warning: the number of axes changed to %d; the device shall be reopened\n",axesCache);
+
+    limCache.resize(axes,2);
+    for (int i=0; i<axes; i++)
+    {
+        limCache(i,0)=replies[2+i].get(1).asDouble();
+        limCache(i,1)=replies[2+i].get(2).asDouble();
+    }
+
+    cacheValid=true;
+    return true;
+}
+
 /**********************************************************/
 bool fakeMotorDeviceClient::getLimits(int axis, double *min, double *max)
 {
     if (!configured || (min==NULL) || (max==NULL))
         return false;
 
+    if (peer!=NULL)
+        return peer->getLimits(axis,min,max);
+
+    // the cache is kept only when the state tells the generation;
+    // servers unable to fill it are queried at each call instead
+    if (binary)
+    {
+        cacheMutex.wait();
+        bool cached=(cacheValid && (cacheGen==remoteGen)) || refreshCache();
+        bool ok=cached && (axis>=0) && (axis<limCache.rows());
+        if (ok)
+        {
+            *min=limCache(axis,0);
+            *max=limCache(axis,1);
+        }
+        cacheMutex.post();
+
+        if (cached)
+            return ok;
+    }
+
     Bottle cmd,reply;
     cmd.addVocab(Vocab::encode("lim"));
     cmd.addVocab(Vocab::encode("get"));
@@ -107,12 +559,54 @@ bool fakeMotorDeviceClient::getLimits(int axis, double *min, double *max)
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceClient::setLimits(int axis, double min, double max)
+{
+    if (!configured)
+        return false;
+
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->setLimits(axis,min,max);
+        peer->unlock();
+        return ret;
+    }
+
+    cacheMutex.wait();
+    cacheValid=false;
+    cacheMutex.post();
+
+    Bottle cmd;
+    cmd.addVocab(Vocab::encode("lim"));
+    cmd.addVocab(Vocab::encode("set"));
+    cmd.addInt(axis);
+    cmd.addDouble(min);
+    cmd.addDouble(max);
+    return sendCommand(cmd);
+}
+
 /**********************************************************/
 bool fakeMotorDeviceClient::getAxes(int *ax)
 {
     if (!configured || (ax==NULL))
         return false;
 
+    if (peer!=NULL)
+        return peer->getAxes(ax);
+
+    if (binary)
+    {
+        cacheMutex.wait();
+        bool cached=(cacheValid && (cacheGen==remoteGen)) || refreshCache();
+        if (cached)
+            *ax=axesCache;
+        cacheMutex.post();
+
+        if (cached)
+            return true;
+    }
+
     Bottle cmd,reply;
     cmd.addVocab(Vocab::encode("enc"));
     cmd.addVocab(Vocab::encode("axes"));
@@ -125,43 +619,322 @@ bool fakeMotorDeviceClient::getAxes(int *ax)
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceClient::negotiateBinary()
+{
+    Bottle cmd,reply;
+    cmd.addVocab(Vocab::encode("wire"));
+    cmd.addVocab(Vocab::encode("bin"));
+    if (rpcPort.write(cmd,reply))
+        return (reply.get(0).asVocab()==Vocab::encode("ack"));
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::isStateFresh(const double rxTime) const
+{
+    if (timeout>0.0)
+        return (Time::now()-rxTime<=timeout);
+    else
+        return true;
+}
+
+/**********************************************************/
+void fakeMotorDeviceClient::syncState()
+{
+    if (!configured || !stateSync)
+        return;
+
+    // the role of the control thread is claimed once for all by
+    // the first caller other than the opener (which reads the
+    // encoders upon start-up), whereas the others get the latest
+    // state straightaway; hence no other thread (e.g. an rpc
+    // handler) shall read all the encoders before the control
+    // thread has started, or it would be paced in its place
+    thread::id self=this_thread::get_id();
+    if (self==syncOpener)
+        return;
+
+    syncMutex.wait();
+    if (syncOwner==thread::id())
+        syncOwner=self;
+    bool owner=(self==syncOwner);
+    syncMutex.post();
+
+    if (owner)
+        getSnapshot().waitMotion(syncWatch,syncWatchdog);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::readState(const size_t field, double *dst)
+{
+    if (!configured || (dst==NULL))
+        return false;
+
+    double stampTime,rxTime;
+    if (getSnapshot().read(field,dst,stampTime,rxTime))
+        return isStateFresh(rxTime);
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::readState(const size_t field, const int j, double *dst)
+{
+    if (!configured || (dst==NULL) || (j<0))
+        return false;
+
+    double stampTime,rxTime;
+    if (getSnapshot().read(field,(size_t)j,*dst,stampTime,rxTime))
+        return isStateFresh(rxTime);
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::sendCommand(Bottle &cmd)
+{
+    Bottle reply;
+    if (rpcPort.write(cmd,reply))
+        return (reply.get(0).asVocab()==Vocab::encode("ack"));
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoder(int j, double *v)
+{
+    return readState(fakeMotorStateSnapshot::POSITION,j,v);
+}
+
 /**********************************************************/
 bool fakeMotorDeviceClient::getEncoders(double *encs)
 {
-    if (!configured || (encs==NULL))
+    syncState();
+    return readState(fakeMotorStateSnapshot::POSITION,encs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderSpeed(int j, double *sp)
+{
+    return readState(fakeMotorStateSnapshot::SPEED,j,sp);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderSpeeds(double *spds)
+{
+    return readState(fakeMotorStateSnapshot::SPEED,spds);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderAcceleration(int j, double *acc)
+{
+    return readState(fakeMotorStateSnapshot::ACCELERATION,j,acc);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderAccelerations(double *accs)
+{
+    return readState(fakeMotorStateSnapshot::ACCELERATION,accs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::setEncoder(int j, double val)
+{
+    if (!configured)
         return false;
 
-    mutex.wait();
-    for (size_t i=0; i<this->encs.length(); i++)
-        encs[i]=this->encs[i];
-    mutex.post();
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->setEncoder(j,val);
+        peer->unlock();
+        return ret;
+    }
 
-    return true;
+    Bottle cmd;
+    cmd.addVocab(Vocab::encode("enc"));
+    cmd.addVocab(Vocab::encode("set"));
+    cmd.addInt(j);
+    cmd.addDouble(val);
+    return sendCommand(cmd);
 }
 
 /**********************************************************/
-bool fakeMotorDeviceClient::velocityMove(int j, double sp)
+bool fakeMotorDeviceClient::setEncoders(const double *vals)
+{
+    if (!configured || (vals==NULL))
+        return false;
+
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->setEncoders(vals);
+        peer->unlock();
+        return ret;
+    }
+
+    Bottle cmd;
+    cmd.addVocab(Vocab::encode("enc"));
+    cmd.addVocab(Vocab::encode("sets"));
+    for (size_t i=0; i<vel.length(); i++)
+        cmd.addDouble(vals[i]);
+    return sendCommand(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::resetEncoder(int j)
 {
     if (!configured)
         return false;
 
-    Bottle cmd,reply;
-    cmd.addVocab(Vocab::encode("vel"));
-    cmd.addVocab(Vocab::encode("move"));
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->resetEncoder(j);
+        peer->unlock();
+        return ret;
+    }
+
+    Bottle cmd;
+    cmd.addVocab(Vocab::encode("enc"));
+    cmd.addVocab(Vocab::encode("rst"));
     cmd.addInt(j);
-    cmd.addDouble(sp);
-    if (rpcPort.write(cmd,reply))
-        return true;
+    return sendCommand(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::resetEncoders()
+{
+    if (!configured)
+        return false;
+
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->resetEncoders();
+        peer->unlock();
+        return ret;
+    }
+
+    Bottle cmd;
+    cmd.addVocab(Vocab::encode("enc"));
+    cmd.addVocab(Vocab::encode("rsts"));
+    return sendCommand(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncodersTimed(double *encs, double *time)
+{
+    if (!configured || (encs==NULL) || (time==NULL))
+        return false;
+
+    syncState();
+
+    double stampTime,rxTime;
+    if (getSnapshot().read(encs,stampTime,rxTime))
+    {
+        // the server stamps all the axes at once
+        for (size_t i=0; i<vel.length(); i++)
+            time[i]=stampTime;
+
+        return isStateFresh(rxTime);
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderTimed(int j, double *enc, double *time)
+{
+    if (!configured || (enc==NULL) || (time==NULL))
+        return false;
+
+    double rxTime;
+    if (getSnapshot().read((size_t)j,*enc,*time,rxTime))
+        return isStateFresh(rxTime);
     else
         return false;
 }
 
+/**********************************************************/
+void fakeMotorDeviceClient::writeVelocities()
+{
+    if (peer!=NULL)
+    {
+        peer->lock();
+        peer->sessionMove(sessionId,vel.data());
+        peer->unlock();
+        return;
+    }
+
+    if (binary)
+    {
+        // the envelope tells the server when the command left
+        Stamp info(++cmdSeq,Time::now());
+        cmdBinPort.prepare().set(vel,cmdSeq,f32);
+        cmdBinPort.setEnvelope(info);
+        cmdBinPort.write();
+        return;
+    }
+
+    Bottle &cmd=cmdPort.prepare();
+    cmd.clear();
+    cmd.addVocab(Vocab::encode("vel"));
+    cmd.addVocab(Vocab::encode("mmov"));
+    for (size_t i=0; i<vel.length(); i++)
+        cmd.addDouble(vel[i]);
+
+    // the same envelope as the binary command
+    Stamp info(++cmdSeq,Time::now());
+    cmdPort.setEnvelope(info);
+    cmdPort.write();
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::velocityMove(int j, double sp)
+{
+    if (!configured || ((size_t)j>=vel.length()))
+        return false;
+
+    cmdMutex.wait();
+    vel[j]=sp;
+    writeVelocities();
+    cmdMutex.post();
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::velocityMove(const double *sp)
+{
+    if (!configured || (sp==NULL))
+        return false;
+
+    cmdMutex.wait();
+    for (size_t i=0; i<vel.length(); i++)
+        vel[i]=sp[i];
+    writeVelocities();
+    cmdMutex.post();
+
+    return true;
+}
+
 /**********************************************************/
 bool fakeMotorDeviceClient::setRefAcceleration(int j, double acc)
 {
     if (!configured)
         return false;
 
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->setRefAcceleration(j,acc);
+        peer->unlock();
+        return ret;
+    }
+
     Bottle cmd,reply;
     cmd.addVocab(Vocab::encode("vel"));
     cmd.addVocab(Vocab::encode("acc"));
@@ -174,20 +947,141 @@ bool fakeMotorDeviceClient::setRefAcceleration(int j, double acc)
 }
 
 /**********************************************************/
-bool fakeMotorDeviceClient::stop(int j)
+bool fakeMotorDeviceClient::setRefAccelerations(const double *accs)
 {
-    if (!configured)
+    if (!configured || (accs==NULL))
         return false;
 
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->setRefAccelerations(accs);
+        peer->unlock();
+        return ret;
+    }
+
     Bottle cmd,reply;
     cmd.addVocab(Vocab::encode("vel"));
-    cmd.addVocab(Vocab::encode("stop"));
-    cmd.addInt(j);
+    cmd.addVocab(Vocab::encode("macc"));
+    for (size_t i=0; i<vel.length(); i++)
+        cmd.addDouble(accs[i]);
     if (rpcPort.write(cmd,reply))
         return true;
     else
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceClient::getRefAcceleration(int j, double *acc)
+{
+    if (!configured || (acc==NULL) || (j<0) || ((size_t)j>=vel.length()))
+        return false;
+
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->getRefAcceleration(j,acc);
+        peer->unlock();
+        return ret;
+    }
+
+    Bottle cmd,reply;
+    cmd.addVocab(Vocab::encode("vel"));
+    cmd.addVocab(Vocab::encode("gacc"));
+    if (rpcPort.write(cmd,reply) && (reply.size()>j+1))
+    {
+        *acc=reply.get(1+j).asDouble();
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getRefAccelerations(double *accs)
+{
+    if (!configured || (accs==NULL))
+        return false;
+
+    if (peer!=NULL)
+    {
+        peer->lock();
+        bool ret=peer->getRefAccelerations(accs);
+        peer->unlock();
+        return ret;
+    }
+
+    Bottle cmd,reply;
+    cmd.addVocab(Vocab::encode("vel"));
+    cmd.addVocab(Vocab::encode("gacc"));
+    if (rpcPort.write(cmd,reply) && ((size_t)reply.size()>vel.length()))
+    {
+        for (size_t i=0; i<vel.length(); i++)
+            accs[i]=reply.get(1+i).asDouble();
+
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::stop(int j)
+{
+    return velocityMove(j,0.0);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::stop()
+{
+    if (!configured)
+        return false;
+
+    cmdMutex.wait();
+    vel=0.0;
+    writeVelocities();
+    cmdMutex.post();
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::tick(const int n)
+{
+    if (!configured || !lockstep)
+        return false;
+
+    if (peer!=NULL)
+        return peer->tick(n);
+
+    Bottle cmd,reply;
+    cmd.addVocab(Vocab::encode("tick"));
+    cmd.addInt(n);
+    if (tickPort.write(cmd,reply))
+        return (reply.get(0).asVocab()==Vocab::encode("ack"));
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getSimTime(double *t)
+{
+    if (!configured || (t==NULL))
+        return false;
+
+    if (peer!=NULL)
+        return peer->getSimTime(t);
+
+    Bottle cmd,reply;
+    cmd.addVocab(Vocab::encode("sim"));
+    cmd.addVocab(Vocab::encode("time"));
+    if (rpcPort.write(cmd,reply) && (reply.get(0).asVocab()==Vocab::encode("ack")))
+    {
+        *t=reply.get(1).asDouble();
+        return true;
+    }
+    else
+        return false;
+}
 
 
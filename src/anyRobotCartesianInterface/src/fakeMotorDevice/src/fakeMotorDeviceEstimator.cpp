@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <private/fakeMotorDeviceEstimator.h>
+
+#include <algorithm>
+
+using namespace std;
+using namespace yarp::sig;
+
+/**********************************************************/
+fakeMotorEstimator::fakeMotorEstimator() : axes(0), Ts(1.0), len(0), head(0)
+{
+    speedWin.len=accWin.len=0;
+}
+
+/**********************************************************/
+void fakeMotorEstimator::configure(Window &w, const size_t len)
+{
+    w.len=len;
+    w.jm=0.5*(len-1);
+
+    w.den1=0.0;
+    for (size_t j=0; j<len; j++)
+        w.den1+=(j-w.jm)*(j-w.jm);
+
+    w.den2=0.0;
+    for (size_t j=0; j<len; j++)
+    {
+        double p2=(j-w.jm)*(j-w.jm)-w.den1/len;
+        w.den2+=p2*p2;
+    }
+
+    w.s0.assign(axes,0.0);
+    w.s1.assign(axes,0.0);
+    w.s2.assign(axes,0.0);
+}
+
+/**********************************************************/
+bool fakeMotorEstimator::configure(const size_t axes, const double Ts,
+                                   const size_t speedWin, const size_t accWin)
+{
+    if ((Ts<=0.0) || (speedWin<2) || (accWin<3))
+        return false;
+
+    this->axes=axes;
+    this->Ts=Ts;
+    len=std::max(speedWin,accWin);
+    head=0;
+    history.assign(len*axes,0.0);
+
+    configure(this->speedWin,speedWin);
+    configure(this->accWin,accWin);
+
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorEstimator::slide(Window &w, const size_t i, const double y_old,
+                               const double y_new)
+{
+    // the samples are indexed from the oldest (0) to the newest
+    // (len-1) within the window, so that dropping the oldest one
+    // shifts the indexes of the others back by one
+    size_t n=w.len-1;
+    double r0=w.s0[i]-y_old;
+    double r1=w.s1[i];
+
+    w.s0[i]=r0+y_new;
+    w.s1[i]=r1-r0+n*y_new;
+    w.s2[i]=w.s2[i]-2.0*r1+r0+n*n*y_new;
+}
+
+/**********************************************************/
+void fakeMotorEstimator::sum(Window &w, const size_t i)
+{
+    double s0=0.0,s1=0.0,s2=0.0;
+    for (size_t j=0; j<w.len; j++)
+    {
+        double y=history[((head+len-w.len+j)%len)*axes+i];
+        s0+=y;
+        s1+=j*y;
+        s2+=j*j*y;
+    }
+
+    w.s0[i]=s0;
+    w.s1[i]=s1;
+    w.s2[i]=s2;
+}
+
+/**********************************************************/
+void fakeMotorEstimator::reset(const Vector &pos)
+{
+    head=0;
+    for (size_t k=0; k<len; k++)
+        for (size_t i=0; i<axes; i++)
+            history[k*axes+i]=pos[i];
+
+    for (size_t i=0; i<axes; i++)
+    {
+        sum(speedWin,i);
+        sum(accWin,i);
+    }
+}
+
+/**********************************************************/
+void fakeMotorEstimator::estimate(const Vector &pos, Vector &speeds, Vector &accels)
+{
+    size_t oldSpeed=((head+len-speedWin.len)%len)*axes;
+    size_t oldAcc=((head+len-accWin.len)%len)*axes;
+    for (size_t i=0; i<axes; i++)
+    {
+        slide(speedWin,i,history[oldSpeed+i],pos[i]);
+        slide(accWin,i,history[oldAcc+i],pos[i]);
+        history[head*axes+i]=pos[i];
+    }
+
+    if (++head>=len)
+    {
+        head=0;
+        for (size_t i=0; i<axes; i++)
+        {
+            sum(speedWin,i);
+            sum(accWin,i);
+        }
+    }
+
+    // the slope of the line and twice the curvature of the parabola,
+    // namely the projections of the samples onto the orthogonal
+    // polynomials (j-jm) and (j-jm)^2-den1/len
+    double kSpeed=1.0/(Ts*speedWin.den1);
+    double kAcc=2.0/(Ts*Ts*accWin.den2);
+    double c0=accWin.jm*accWin.jm-accWin.den1/accWin.len;
+    for (size_t i=0; i<axes; i++)
+    {
+        speeds[i]=kSpeed*(speedWin.s1[i]-speedWin.jm*speedWin.s0[i]);
+        accels[i]=kAcc*(accWin.s2[i]-2.0*accWin.jm*accWin.s1[i]+c0*accWin.s0[i]);
+    }
+}
+
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <private/fakeMotorDeviceFaults.h>
+
+#include <stdio.h>
+#include <math.h>
+#include <string>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+
+/**********************************************************/
+fakeMotorFaults::fakeMotorFaults() : uniform(0.0,1.0), normal(0.0,1.0)
+{
+    latency=jitter=drop=reorder=hold=quantum=noise=0.0;
+    dist=UNIFORM;
+    enabled=false;
+    last=NULL;
+    reset();
+}
+
+/**********************************************************/
+bool fakeMotorFaults::configure(Searchable &config, const unsigned int seed,
+                                const size_t len, const double Ts)
+{
+    latency=config.check("latency",Value(0.0)).asDouble();
+    jitter=config.check("jitter",Value(0.0)).asDouble();
+    drop=config.check("drop",Value(0.0)).asDouble();
+    reorder=config.check("reorder",Value(0.0)).asDouble();
+    hold=config.check("hold",Value(2.0*Ts)).asDouble();
+    quantum=config.check("quantum",Value(0.0)).asDouble();
+    noise=config.check("noise",Value(0.0)).asDouble();
+
+    string d=config.check("dist",Value("uniform")).asString().c_str();
+    if (d=="uniform")
+        dist=UNIFORM;
+    else if (d=="normal")
+        dist=NORMAL;
+    else if (d=="exponential")
+        dist=EXPONENTIAL;
+    else
+    {
+        printf("Error: unknown jitter distribution \"%s\"\n",d.c_str());
+        return false;
+    }
+
+    if ((latency<0.0) || (jitter<0.0) || (hold<0.0) || (quantum<0.0) || (noise<0.0) ||
+        (drop<0.0) || (drop>1.0) || (reorder<0.0) || (reorder>1.0))
+    {
+        printf("Error: invalid fault parameters\n");
+        return false;
+    }
+
+    gen.seed(seed);
+    uniform.reset();
+    normal.reset();
+
+    enabled=(latency>0.0) || (jitter>0.0) || (drop>0.0) || (reorder>0.0);
+
+    // room for the messages sent over the longest delay
+    // we reasonably expect, with some margin
+    size_t capacity=0;
+    if (enabled)
+    {
+        double horizon=latency+4.0*jitter+((reorder>0.0)?hold:0.0);
+        capacity=(size_t)ceil(horizon/(Ts>0.0?Ts:0.001))+8;
+        if (capacity>1024)
+            capacity=1024;
+    }
+
+    pool.resize(capacity);
+    for (size_t i=0; i<pool.size(); i++)
+    {
+        pool[i].data.resize(len,0.0);
+        pool[i].busy=false;
+    }
+
+    last=NULL;
+    reset();
+    return true;
+}
+
+/**********************************************************/
+double fakeMotorFaults::sampleJitter()
+{
+    if (jitter<=0.0)
+        return 0.0;
+    else if (dist==NORMAL)
+        return jitter*normal(gen);
+    else if (dist==EXPONENTIAL)
+        return -jitter*log(1.0-uniform(gen));
+    else
+        return jitter*(2.0*uniform(gen)-1.0);
+}
+
+/**********************************************************/
+bool fakeMotorFaults::push(const Vector &data, const double time,
+                           const unsigned int seq, const int tag, const double now)
+{
+    sent++;
+
+    // the random numbers are always drawn in the same order
+    // to keep the sequence of faults reproducible
+    bool lost=(uniform(gen)<drop);
+    bool late=(uniform(gen)<reorder);
+    double delay=latency+sampleJitter();
+    if (delay<0.0)
+        delay=0.0;
+
+    if (lost)
+    {
+        dropped++;
+        return false;
+    }
+
+    if (late)
+    {
+        delay+=hold;
+        reordered++;
+    }
+
+    for (size_t i=0; i<pool.size(); i++)
+    {
+        Packet &packet=pool[i];
+        if (!packet.busy)
+        {
+            packet.release=now+delay;
+            packet.time=time;
+            packet.seq=seq;
+            packet.tag=tag;
+            for (size_t j=0; (j<data.length()) && (j<packet.data.length()); j++)
+                packet.data[j]=data[j];
+            packet.busy=true;
+            return true;
+        }
+    }
+
+    overflows++;
+    return false;
+}
+
+/**********************************************************/
+const fakeMotorFaults::Packet *fakeMotorFaults::pop(const double now)
+{
+    // the message delivered last time is given back to the pool
+    if (last!=NULL)
+    {
+        last->busy=false;
+        last=NULL;
+    }
+
+    for (size_t i=0; i<pool.size(); i++)
+    {
+        Packet &packet=pool[i];
+        if (packet.busy && (packet.release<=now))
+            if ((last==NULL) || (packet.release<last->release) ||
+                ((packet.release==last->release) && (packet.time<last->time)))
+                last=&packet;
+    }
+
+    return last;
+}
+
+/**********************************************************/
+void fakeMotorFaults::corrupt(Vector &data, const size_t n)
+{
+    for (size_t i=0; (i<n) && (i<data.length()); i++)
+    {
+        if (noise>0.0)
+            data[i]+=noise*normal(gen);
+
+        if (quantum>0.0)
+            data[i]=quantum*floor(data[i]/quantum+0.5);
+    }
+}
+
+/**********************************************************/
+void fakeMotorFaults::reset()
+{
+    sent=dropped=reordered=overflows=0;
+}
+
+/**********************************************************/
+void fakeMotorFaults::toBottle(Bottle &b) const
+{
+    size_t inFlight=0;
+    for (size_t i=0; i<pool.size(); i++)
+        if (pool[i].busy)
+            inFlight++;
+
+    Bottle &b0=b.addList(); b0.addString("sent");      b0.addInt((int)sent);
+    Bottle &b1=b.addList(); b1.addString("dropped");   b1.addInt((int)dropped);
+    Bottle &b2=b.addList(); b2.addString("reordered"); b2.addInt((int)reordered);
+    Bottle &b3=b.addList(); b3.addString("overflows"); b3.addInt((int)overflows);
+    Bottle &b4=b.addList(); b4.addString("in_flight"); b4.addInt((int)inFlight);
+}
+
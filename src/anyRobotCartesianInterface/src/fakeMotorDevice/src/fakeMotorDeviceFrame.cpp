@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <private/fakeMotorDeviceFrame.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+
+/**********************************************************/
+void fakeMotorFrame::set(const Vector &data, const unsigned int seq,
+                         const bool f32)
+{
+    if (payload.length()!=data.length())
+        payload.resize(data.length());
+
+    for (size_t i=0; i<data.length(); i++)
+        payload[i]=data[i];
+
+    this->seq=seq;
+    this->f32=f32;
+}
+
+/**********************************************************/
+bool fakeMotorFrame::write(ConnectionWriter &connection)
+{
+    // the binary layout cannot be rendered as text
+    if (connection.isTextMode())
+        return false;
+
+    size_t n=payload.length();
+
+    connection.appendInt(MAGIC);
+    connection.appendInt(f32?0x01:0x00);
+    connection.appendInt((int)seq);
+    connection.appendInt((int)ack);
+    connection.appendInt((int)gen);
+    connection.appendInt((int)n);
+
+    if (n==0)
+        return true;
+
+    if (f32)
+    {
+        if (buf32.size()!=n)
+            buf32.resize(n);
+
+        for (size_t i=0; i<n; i++)
+            buf32[i]=(float)payload[i];
+
+        connection.appendBlock((const char*)&buf32[0],n*sizeof(float));
+    }
+    else
+        connection.appendBlock((const char*)payload.data(),n*sizeof(double));
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorFrame::read(ConnectionReader &connection)
+{
+    if (connection.isTextMode())
+        return false;
+
+    if (connection.expectInt()!=MAGIC)
+        return false;
+
+    int flags=connection.expectInt();
+    unsigned int seq=(unsigned int)connection.expectInt();
+    unsigned int ack=(unsigned int)connection.expectInt();
+    unsigned int gen=(unsigned int)connection.expectInt();
+    int n=connection.expectInt();
+    if ((n<0) || (n>MAX_SIZE))
+        return false;
+
+    if (payload.length()!=(size_t)n)
+        payload.resize(n);
+
+    this->seq=seq;
+    this->ack=ack;
+    this->gen=gen;
+    f32=((flags&0x01)!=0);
+
+    if (n==0)
+        return connection.isValid();
+
+    bool ok;
+    if (f32)
+    {
+        if (buf32.size()!=(size_t)n)
+            buf32.resize(n);
+
+        ok=connection.expectBlock((const char*)&buf32[0],n*sizeof(float));
+        for (int i=0; ok && (i<n); i++)
+            payload[i]=buf32[i];
+    }
+    else
+        ok=connection.expectBlock((const char*)payload.data(),n*sizeof(double));
+
+    return ok && connection.isValid();
+}
+
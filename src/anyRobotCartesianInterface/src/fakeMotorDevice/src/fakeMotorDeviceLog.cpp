@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <private/fakeMotorDeviceLog.h>
+
+#include <string.h>
+
+#if defined(_WIN32)
+    #include <fstream>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace yarp::sig;
+
+/**********************************************************/
+fakeMotorLogWriter::fakeMotorLogWriter() : file(NULL), axes(0), fields(0)
+{
+}
+
+/**********************************************************/
+fakeMotorLogWriter::~fakeMotorLogWriter()
+{
+    close();
+}
+
+/**********************************************************/
+bool fakeMotorLogWriter::open(const string &name, const int axes, const int fields,
+                              const double Ts)
+{
+    close();
+
+    file=fopen(name.c_str(),"wb");
+    if (file==NULL)
+        return false;
+
+    // records are buffered not to hit the disk at each tick
+    setvbuf(file,NULL,_IOFBF,1<<20);
+
+    this->axes=axes;
+    this->fields=fields;
+    record.assign(fakeMotorLog::recordSize(axes,fields),0);
+
+    char header[fakeMotorLog::HEADER_SIZE];
+    int version=fakeMotorLog::VERSION;
+    memcpy(header,"FMDL",4);
+    memcpy(header+4,&version,4);
+    memcpy(header+8,&axes,4);
+    memcpy(header+12,&fields,4);
+    memcpy(header+16,&Ts,8);
+
+    return (fwrite(header,sizeof(header),1,file)==1);
+}
+
+/**********************************************************/
+bool fakeMotorLogWriter::write(const int kind, const double t, const int session,
+                               const unsigned int seq, const Vector &data)
+{
+    if (file==NULL)
+        return false;
+
+    size_t n=(size_t)(axes*fields);
+    size_t len=(data.length()<n)?data.length():n;
+
+    size_t prefix=fakeMotorLog::PREFIX_SIZE;
+    memcpy(&record[0],&t,8);
+    memcpy(&record[8],&kind,4);
+    memcpy(&record[12],&seq,4);
+    memcpy(&record[16],&session,4);
+    memset(&record[20],0,4);
+    if (len>0)
+        memcpy(&record[prefix],data.data(),sizeof(double)*len);
+    if (len<n)
+        memset(&record[prefix+sizeof(double)*len],0,sizeof(double)*(n-len));
+
+    return (fwrite(&record[0],record.size(),1,file)==1);
+}
+
+/**********************************************************/
+void fakeMotorLogWriter::close()
+{
+    if (file!=NULL)
+    {
+        fclose(file);
+        file=NULL;
+    }
+}
+
+/**********************************************************/
+fakeMotorLogReader::fakeMotorLogReader() : base(NULL), length(0), axes(0),
+                                           fields(0), Ts(0.0), records(0)
+{
+}
+
+/**********************************************************/
+fakeMotorLogReader::~fakeMotorLogReader()
+{
+    close();
+}
+
+/**********************************************************/
+bool fakeMotorLogReader::open(const string &name)
+{
+    close();
+
+#if defined(_WIN32)
+    ifstream fin(name.c_str(),ios::binary);
+    if (!fin.is_open())
+        return false;
+
+    buffer.assign(istreambuf_iterator<char>(fin),istreambuf_iterator<char>());
+    base=buffer.empty()?NULL:&buffer[0];
+    length=buffer.size();
+#else
+    int fd=::open(name.c_str(),O_RDONLY);
+    if (fd<0)
+        return false;
+
+    struct stat info;
+    if ((fstat(fd,&info)!=0) || (info.st_size<(off_t)fakeMotorLog::HEADER_SIZE))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *addr=mmap(NULL,(size_t)info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (addr==MAP_FAILED)
+        return false;
+
+    base=(const char*)addr;
+    length=(size_t)info.st_size;
+#endif
+
+    int version=0;
+    if ((length<fakeMotorLog::HEADER_SIZE) || (memcmp(base,"FMDL",4)!=0))
+    {
+        close();
+        return false;
+    }
+
+    memcpy(&version,base+4,4);
+    memcpy(&axes,base+8,4);
+    memcpy(&fields,base+12,4);
+    memcpy(&Ts,base+16,8);
+
+    if ((version!=fakeMotorLog::VERSION) || (axes<=0) || (fields<=0))
+    {
+        close();
+        return false;
+    }
+
+    // a truncated last record is neglected
+    records=(length-fakeMotorLog::HEADER_SIZE)/fakeMotorLog::recordSize(axes,fields);
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorLogReader::close()
+{
+#if !defined(_WIN32)
+    if (base!=NULL)
+        munmap((void*)base,length);
+#endif
+
+    buffer.clear();
+    base=NULL;
+    length=0;
+    records=0;
+}
+
+/**********************************************************/
+const double *fakeMotorLogReader::get(const size_t i, int &kind, double &t,
+                                      int &session, unsigned int &seq) const
+{
+    if (i>=records)
+        return NULL;
+
+    const char *record=base+fakeMotorLog::HEADER_SIZE+i*fakeMotorLog::recordSize(axes,fields);
+    memcpy(&t,record,8);
+    memcpy(&kind,record+8,4);
+    memcpy(&seq,record+12,4);
+    memcpy(&session,record+16,4);
+
+    // the records are 8-byte aligned within the mapping
+    return (const double*)(record+fakeMotorLog::PREFIX_SIZE);
+}
+
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <private/fakeMotorDevicePlant.h>
+
+#include <stdio.h>
+#include <math.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+
+/**********************************************************/
+fakeMotorPlant::fakeMotorPlant() : Ts(0.01), head(0)
+{
+}
+
+/**********************************************************/
+bool fakeMotorPlant::configureDynamics(const int j, Searchable &axis)
+{
+    acc[j]=axis.check("acc",Value(0.0)).asDouble();
+    Kp[j]=axis.check("Kp",Value(1.0)).asDouble();
+    double Tz=axis.check("Tz",Value(0.0)).asDouble();
+    double Tw=axis.check("Tw",Value(0.0)).asDouble();
+    double Zeta=axis.check("Zeta",Value(0.0)).asDouble();
+    double Td=axis.check("Td",Value(0.0)).asDouble();
+
+    if ((Tz<0.0) || (Tw<0.0) || (Zeta<0.0) || (Td<0.0))
+    {
+        printf("Error: negative plant parameters for axis %d\n",j);
+        return false;
+    }
+
+    // without poles the lead term would be improper
+    bypass[j]=(Tw==0.0);
+    if (bypass[j] && (Tz!=0.0))
+        printf("Warning: Tz is neglected for axis %d since Tw is zero\n",j);
+
+    if (!bypass[j])
+    {
+        // Tustin discretization of (1+Tz*s)/(1+2*Zeta*Tw*s+(Tw*s)^2)
+        double c=2.0/Ts;
+        double a0=1.0+2.0*Zeta*Tw*c+Tw*Tw*c*c;
+
+        num(j,0)=(1.0+Tz*c)/a0;
+        num(j,1)=2.0/a0;
+        num(j,2)=(1.0-Tz*c)/a0;
+        den(j,0)=(2.0-2.0*Tw*Tw*c*c)/a0;
+        den(j,1)=(1.0-2.0*Zeta*Tw*c+Tw*Tw*c*c)/a0;
+    }
+
+    delay[j]=(size_t)floor(Td/Ts+0.5);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorPlant::configure(Searchable &config, const double Ts)
+{
+    if (Ts<=0.0)
+    {
+        printf("Error: invalid sample time %g [s]\n",Ts);
+        return false;
+    }
+
+    this->Ts=Ts;
+
+    int numAxes=config.check("numAxes",Value(3)).asInt();
+    if (numAxes<=0)
+    {
+        printf("Error: invalid number of axes %d\n",numAxes);
+        return false;
+    }
+
+    lim.resize(numAxes,2);
+    pos.resize(numAxes);
+    acc.resize(numAxes,0.0);
+    vref.resize(numAxes,0.0);
+    Kp.resize(numAxes,1.0);
+    num.resize(numAxes,3); num.zero();
+    den.resize(numAxes,2); den.zero();
+    bypass.assign(numAxes,true);
+    u_old.resize(numAxes,2); u_old.zero();
+    y_old.resize(numAxes,2); y_old.zero();
+    vel_old.resize(numAxes,0.0);
+    delay.assign(numAxes,0);
+
+    if (config.check("numAxes"))
+    {
+        for (int i=0; i<numAxes; i++)
+        {
+            char entry[32];
+            sprintf(entry,"axis_%d",i);
+
+            Bottle &axis=config.findGroup(entry);
+            if (axis.isNull() || !axis.check("min") || !axis.check("max"))
+            {
+                printf("Error: \"%s\" is missing or incomplete\n",entry);
+                return false;
+            }
+
+            lim(i,0)=axis.find("min").asDouble();
+            lim(i,1)=axis.find("max").asDouble();
+            if (lim(i,0)>lim(i,1))
+            {
+                printf("Error: \"%s\" has min>max\n",entry);
+                return false;
+            }
+
+            double init=axis.check("init",Value((lim(i,0)+lim(i,1))/2.0)).asDouble();
+            pos[i]=(init<lim(i,0))?lim(i,0):((init>lim(i,1))?lim(i,1):init);
+
+            if (!configureDynamics(i,axis))
+                return false;
+        }
+    }
+    else
+    {
+        // the part is composed of three rotational joints
+        // whose bounds are given in degrees just below
+        lim(0,0)=-180.0; lim(0,1)=180.0;    // joint 0
+        lim(1,0)=-90.0;  lim(1,1)=90.0;     // joint 1
+        lim(2,0)=-45.0;  lim(2,1)=45.0;     // joint 2
+
+        Property defaults;
+        for (int i=0; i<lim.rows(); i++)
+        {
+            pos[i]=(lim(i,0)+lim(i,1))/2.0;
+            configureDynamics(i,defaults);
+        }
+    }
+
+    // the delay lines are long enough to
+    // accommodate the largest transport delay
+    size_t len=1;
+    for (size_t i=0; i<delay.size(); i++)
+        if (delay[i]+1>len)
+            len=delay[i]+1;
+
+    line.resize(numAxes,(int)len);
+    line.zero();
+    head=0;
+
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorPlant::step(const Vector &vel)
+{
+    size_t len=(size_t)line.cols();
+
+    for (size_t i=0; i<pos.length(); i++)
+    {
+        // acceleration saturation
+        double u=vel[i];
+        if (acc[i]>0.0)
+        {
+            double dv=u-vref[i];
+            double dv_max=acc[i]*Ts;
+            u=vref[i]+((dv>dv_max)?dv_max:((dv<-dv_max)?-dv_max:dv));
+        }
+        vref[i]=u;
+
+        // transport delay
+        line(i,head)=u;
+        u=line(i,(head+len-delay[i])%len);
+
+        // lead-lag dynamics
+        double y=u;
+        if (!bypass[i])
+        {
+            y=num(i,0)*u+num(i,1)*u_old(i,0)+num(i,2)*u_old(i,1)
+              -den(i,0)*y_old(i,0)-den(i,1)*y_old(i,1);
+
+            u_old(i,1)=u_old(i,0); u_old(i,0)=u;
+            y_old(i,1)=y_old(i,0); y_old(i,0)=y;
+        }
+        y*=Kp[i];
+
+        // trapezoidal integration with saturation
+        double p=pos[i]+0.5*Ts*(y+vel_old[i]);
+        pos[i]=(p<lim(i,0))?lim(i,0):((p>lim(i,1))?lim(i,1):p);
+        vel_old[i]=y;
+    }
+
+    head=(head+1)%len;
+}
+
+/**********************************************************/
+bool fakeMotorPlant::setRefAcceleration(const int j, const double acc)
+{
+    if ((j>=0) && (j<(int)this->acc.length()))
+    {
+        this->acc[j]=acc;
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorPlant::setLim(const int j, const double min, const double max)
+{
+    if ((j>=0) && (j<(int)pos.length()) && (min<=max))
+    {
+        lim(j,0)=min; lim(j,1)=max;
+        return set(j,pos[j]);
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorPlant::set(const int j, const double val)
+{
+    if ((j>=0) && (j<(int)pos.length()))
+    {
+        pos[j]=(val<lim(j,0))?lim(j,0):((val>lim(j,1))?lim(j,1):val);
+        return true;
+    }
+    else
+        return false;
+}
+
@@ -18,19 +18,61 @@
 #include <private/fakeMotorDeviceComponents.h>
 
 #include <string>
+#include <map>
+#include <sstream>
 #include <stdio.h>
+#include <math.h>
 
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::dev;
 using namespace yarp::sig;
-using namespace iCub::ctrl;
+
+namespace
+{
+    // the flags attached to the commands in flight
+    enum { CMD_BINARY=0x01, CMD_STAMPED=0x02 };
+
+    // the servers opened within this process
+    map<string,fakeMotorDeviceServer*> &registry()
+    {
+        static map<string,fakeMotorDeviceServer*> servers;
+        return servers;
+    }
+
+    Semaphore &registryMutex()
+    {
+        static Semaphore mutex;
+        return mutex;
+    }
+}
 
 /**********************************************************/
-fakeMotorDeviceServer::fakeMotorDeviceServer() : RateThread(10)
+fakeMotorDeviceServer::fakeMotorDeviceServer() : RateThread(10), sessions(mutex), peers(0)
 {
-    motors=NULL;
+    ticks=0;
+    generation=0;
+    recorder=NULL;
+    player=NULL;
+    replayIdx=0;
+    replayLast=(size_t)-1;
+    replaySpeed=1.0;
+    replayT0=0.0;
+    replayWall0=-1.0;
+    replayLoop=false;
+    cmdFifo=false;
+    cmdQueue=100;
+    cmdMaxAge=0.0;
+    rpcReplyIds=0;
+    cmdAck=0;
+    cmdTime=-1.0;
+    diagPeriod=1.0;
+    lastDiag=0.0;
+    lockstep=false;
+    external=false;
     configured=false;
+    tickReader.setOwner(this);
+    rpcAsyncPort.setOwner(this);
 }
 
 /**********************************************************/
@@ -41,33 +83,233 @@ bool fakeMotorDeviceServer::open(Searchable &config)
     string local=config.check("local",Value("/fakeyServer")).asString().c_str();
     int Ts=config.check("Ts",Value(10)).asInt();
 
+    // in lock-step mode the plant is not advanced periodically
+    // but only when ticks are received through the dedicated port
+    lockstep=(config.check("lockstep",Value("off")).asString()=="on");
+
+    // with an external scheduler the plant is advanced in-process
+    // through IFakeMotorLockStep::tick() by the owner of the device
+    // (e.g. one thread stepping many parts), still in real-time
+    external=lockstep || (config.check("scheduler",Value("internal")).asString()=="external");
+
+    // the motors themselves are represented
+    // by pure integrators that give back joints
+    // positions when fed with joints velocities;
+    // the part is described by the configuration
+    if (!motors.configure(config,0.001*Ts))
+    {
+        printf("Fake Motor Device Server failed to open\n");
+        return false;
+    }
+
+    vel.resize(motors.getAxes(),0.0);
+    cmdBuf.resize(motors.getAxes(),0.0);
+
+    // the commands policy: "latest" (default) applies the newest
+    // command pending at each tick, whereas "fifo" applies one
+    // pending command per tick in the order of arrival; commands
+    // older than cmd_max_age [s] are discarded and the joints are
+    // stopped if no fresh command arrives within the same time, in
+    // which case the clients shall refresh their commands (0.0
+    // disables the check, which relies on synchronized clocks)
+    cmdFifo=(config.check("cmd_policy",Value("latest")).asString()=="fifo");
+    cmdMaxAge=config.check("cmd_max_age",Value(0.0)).asDouble();
+
+    // the commands pending on each port are queued up to cmd_queue,
+    // beyond which the oldest ones are dropped (e.g. when the ticks
+    // stop coming in lock-step mode)
+    int queue=config.check("cmd_queue",Value(100)).asInt();
+    cmdQueue=(queue>0)?(size_t)queue:1;
+
+    // the default session is fed through cmd:i, cmd_bin:i and the
+    // rpc; the clients might open further sessions with their own
+    // priorities and joints (see openSession())
+    sessions.configure(local,motors.getAxes(),cmdQueue,&cmdPort,&cmdBinPort);
+
+    // the traffic can be recorded into a binary log, whereas in
+    // replay the states are taken from a log in place of the plant
+    // at replay_speed times the recorded rate (combined with the
+    // lock-step mode the log is rather played as fast as ticked)
+    if (config.check("record"))
+    {
+        string file=config.find("record").asString().c_str();
+        recorder=new fakeMotorLogWriter;
+        if (!recorder->open(file,(int)motors.getAxes(),3,motors.getTs()))
+        {
+            printf("Unable to create the log \"%s\"\n",file.c_str());
+            printf("Fake Motor Device Server failed to open\n");
+            delete recorder;
+            recorder=NULL;
+            return false;
+        }
+    }
+
+    if (config.check("replay"))
+    {
+        string file=config.find("replay").asString().c_str();
+        player=new fakeMotorLogReader;
+        // the states are not resampled, hence the log shall have
+        // been recorded with the same period
+        if (!player->open(file) || (player->getAxes()!=(int)motors.getAxes()) ||
+            (player->getFields()!=3) || (fabs(player->getTs()-motors.getTs())>1e-9))
+        {
+            printf("Unable to replay the log \"%s\" (recorded with %g s)\n",
+                   file.c_str(),player->getTs());
+            printf("Fake Motor Device Server failed to open\n");
+            delete player;
+            delete recorder;
+            player=NULL;
+            recorder=NULL;
+            return false;
+        }
+
+        replayIdx=0;
+        replayLast=(size_t)-1;
+        replayWall0=-1.0;
+
+        // the recorded time the replay starts from
+        replayT0=0.0;
+        for (size_t i=0; i<player->size(); i++)
+        {
+            int kind,session; double t; unsigned int seq;
+            player->get(i,kind,t,session,seq);
+            if (kind==fakeMotorLog::STATE)
+            {
+                replayT0=t;
+                break;
+            }
+        }
+        replayLoop=(config.check("replay_loop",Value("off")).asString()=="on");
+        replaySpeed=config.check("replay_speed",Value(1.0)).asDouble();
+        if (replaySpeed<=0.0)
+            replaySpeed=1.0;
+    }
+
+    // the speeds and the accelerations are estimated once per tick
+    // by fitting a line and a parabola over the latest speed_window
+    // and acc_window positions respectively (see fakeMotorEstimator)
+    int speedWin=config.check("speed_window",Value(8)).asInt();
+    int accWin=config.check("acc_window",Value(12)).asInt();
+    if (!estimator.configure(motors.getAxes(),motors.getTs(),
+                             speedWin>2?speedWin:2,accWin>3?accWin:3))
+    {
+        printf("Fake Motor Device Server failed to open\n");
+        delete recorder;
+        delete player;
+        recorder=NULL;
+        player=NULL;
+        return false;
+    }
+
+    estimator.reset(motors.get());
+    speeds.resize(motors.getAxes(),0.0);
+    accels.resize(motors.getAxes(),0.0);
+
+    snapshot.resize(motors.getAxes(),3);
+
+    // the loop statistics: ticks whose period exceeds Ts by more
+    // than the given fraction are deemed late; the diagnostics
+    // are streamed every diag_period [s]
+    stats.configure(Ts,config.check("stat_bins",Value(20)).asInt(),
+                    config.check("late_tolerance",Value(0.5)).asDouble());
+    diagPeriod=config.check("diag_period",Value(1.0)).asDouble();
+
+    // the streaming links can be degraded on purpose through the
+    // fault_state and fault_cmd options (see fakeMotorFaults); the
+    // faults are drawn from generators seeded with fault_seed, so
+    // that they can be reproduced across runs
+    unsigned int seed=(unsigned int)config.check("fault_seed",Value(0)).asInt();
+    Bottle &faultState=config.findGroup("fault_state");
+    Bottle &faultCmd=config.findGroup("fault_cmd");
+    if (!stateFaults.configure(faultState,seed,3*motors.getAxes(),0.001*Ts) ||
+        !cmdFaults.configure(faultCmd,seed+1,motors.getAxes(),0.001*Ts))
+    {
+        printf("Fake Motor Device Server failed to open\n");
+        delete recorder;
+        delete player;
+        recorder=NULL;
+        player=NULL;
+        return false;
+    }
+
+    stateBuf.resize(3*motors.getAxes(),0.0);
+    stateOut.resize(3*motors.getAxes(),0.0);
+
+    // state:o streams the positions only, whereas state_ext:o
+    // streams the whole state: [pos] [speeds] [accels]
     statePort.open((local+"/state:o").c_str());
+    stateExtPort.open((local+"/state_ext:o").c_str());
+    cmdPort.setCapacity(cmdQueue);
     cmdPort.open((local+"/cmd:i").c_str());
     rpcPort.open((local+"/rpc").c_str());
     rpcPort.setReader(*this);
- 
-    // the part is composed of three rotational joints
-    // whose bounds are given in degrees just below
-    Matrix lim(3,2);
-    lim(0,0)=-180.0; lim(0,1)=180.0;    // joint 0
-    lim(1,0)=-90.0;  lim(1,1)=90.0;     // joint 1
-    lim(2,0)=-45.0;  lim(2,1)=45.0;     // joint 2
-
-    Vector q0;
-    for (int i=0; i<lim.rows(); i++)
-        q0.push_back((lim(i,0)+lim(i,1))/2.0);
 
-    // the motors themselves are represented
-    // by pure integrators that give back joints
-    // positions when fed with joints velocities
-    motors=new Integrator(0.001*Ts,q0,lim);
-    vel.resize(motors->get().length(),0.0);        
+    // the binary counterparts of the streaming ports, to be used by
+    // the clients that negotiated it; the state is streamed in double
+    // precision and, on a port of its own, in single precision
+    stateBinPort.open((local+"/state_bin:o").c_str());
+    stateBin32Port.open((local+"/state_bin32:o").c_str());
+    cmdBinPort.setCapacity(cmdQueue);
+    cmdBinPort.open((local+"/cmd_bin:i").c_str());
+    diagPort.open((local+"/diag:o").c_str());
+
+    // the pipelined counterpart of the rpc port, whose replies
+    // go through the ports opened on request (see respondRpc())
+    rpcAsyncPort.open((local+"/rpc_async:i").c_str());
 
-    setRate(Ts);
-    start();
+    // the generation lets the clients invalidate what they cached
+    // and differs across restarts of the server (the time in [ms]
+    // is wrapped to fit, zero being reserved to the unknown one)
+    generation=(unsigned int)fmod(1000.0*Time::now(),4294967296.0);
+    if (generation==0)
+        generation=1;
 
+    ticks=0;
+    cmdAck=0;
+    cmdTime=-1.0;
+    lastDiag=0.0;
     configured=true;
 
+    // make the server reachable by the in-process clients
+    name=local;
+    registryMutex().wait();
+    registry()[name]=this;
+    registryMutex().post();
+
+    if (lockstep)
+    {
+        tickPort.open((local+"/tick:i").c_str());
+        tickPort.setReader(tickReader);
+
+        // the simulated time can be also published to serve
+        // as network clock for the other components
+        if (config.check("clock"))
+            clockPort.open(config.find("clock").asString().c_str());
+
+        printf("Fake Motor Device Server running in lock-step mode\n");
+    }
+
+    // the initial state (tick 0) is published straight away, so that
+    // the clients get the encoders before the first tick, which in
+    // lock-step mode is up to the owner of the simulation
+    const Vector &pos=motors.get();
+    for (size_t i=0; i<pos.length(); i++)
+        stateBuf[i]=pos[i];
+
+    if (lockstep)
+        stamp.update(0.0);
+    else
+        stamp.update();
+
+    publish(stateBuf,stamp,ticks,cmdAck);
+    snapshot.write(stateBuf,stamp,Time::now());
+
+    if (!external)
+    {
+        setRate(Ts);
+        start();
+    }
+
     printf("Fake Motor Device Server successfully open\n");
     return true;
 }
@@ -77,26 +319,60 @@ bool fakeMotorDeviceServer::close()
 {
     printf("Closing Fake Motor Device Server ...\n");
 
+    // the thread is stopped out of the critical section
+    // since run() needs to acquire the mutex to return
     if (isRunning())
-        stop();
+        RateThread::stop();
 
-    mutex.wait();
-    RateThread::stop();
-    mutex.post();
+    registryMutex().wait();
+    map<string,fakeMotorDeviceServer*>::iterator it=registry().find(name);
+    if ((it!=registry().end()) && (it->second==this))
+        registry().erase(it);
+    if (peers>0)
+        printf("Warning: %d in-process clients still attached\n",(int)peers);
+    registryMutex().post();
 
     statePort.interrupt();
+    stateExtPort.interrupt();
     cmdPort.interrupt();
+    stateBinPort.interrupt();
+    stateBin32Port.interrupt();
+    cmdBinPort.interrupt();
+    diagPort.interrupt();
+    rpcAsyncPort.interrupt();
     rpcPort.interrupt();
+    tickPort.interrupt();
+    clockPort.interrupt();
 
     statePort.close();
+    stateExtPort.close();
     cmdPort.close();
+    stateBinPort.close();
+    stateBin32Port.close();
+    cmdBinPort.close();
+    diagPort.close();
+    rpcAsyncPort.close();
     rpcPort.close();
+    tickPort.close();
+    clockPort.close();
 
-    if (motors!=NULL)
+    // the reply ports of the pipelined rpc
+    for (map<int,BufferedPort<Bottle>*>::iterator it=rpcReplyPorts.begin();
+         it!=rpcReplyPorts.end(); it++)
     {
-        delete motors;
-        motors=NULL;
+        it->second->interrupt();
+        it->second->close();
+        delete it->second;
     }
+    rpcReplyPorts.clear();
+
+    // the sessions opened by the clients
+    sessions.clear();
+
+    delete recorder;
+    delete player;
+    recorder=NULL;
+    player=NULL;
 
     configured=false;
 
@@ -105,34 +381,637 @@ bool fakeMotorDeviceServer::close()
 }
 
 /**********************************************************/
-void fakeMotorDeviceServer::run()
+void fakeMotorDeviceServer::advance()
 {
-    mutex.wait();
+    double t0=Time::now();
+
+    readCommands(t0);
 
-    if (Bottle *cmd=cmdPort.read(false))
+    ticks++;
+    if (lockstep)
+        stamp.update(ticks*motors.getTs());
+    else
+        stamp.update();
+
+    // the state is filled in place not to allocate at each tick
+    size_t n=vel.length();
+    Vector &state=stateBuf;
+
+    if ((player==NULL) || !replay(state))
     {
-        if ((size_t)cmd->size()>=vel.length())
-            for (size_t i=0; i<vel.length(); i++)
-                vel[i]=cmd->get(i).asDouble();
+        motors.step(vel);
+
+        const Vector &pos=motors.get();
+        estimator.estimate(pos,speeds,accels);
+
+        for (size_t i=0; i<n; i++)
+        {
+            state[i]=pos[i];
+            state[n+i]=speeds[i];
+            state[2*n+i]=accels[i];
+        }
+    }
+
+    if (recorder!=NULL)
+        recorder->write(fakeMotorLog::STATE,stamp.getTime(),-1,ticks,state);
+
+    // the states in flight are delivered in order of arrival,
+    // still carrying the envelope of the time they were produced
+    if (stateFaults.isEnabled())
+    {
+        stateFaults.push(state,stamp.getTime(),ticks,(int)cmdAck,t0);
+
+        const fakeMotorFaults::Packet *packet;
+        while ((packet=stateFaults.pop(t0))!=NULL)
+        {
+            Stamp info((int)packet->seq,packet->time);
+            publish(packet->data,info,packet->seq,(unsigned int)packet->tag);
+        }
+    }
+    else
+        publish(state,stamp,ticks,cmdAck);
+
+    double t1=Time::now();
+
+    // time elapsed since the dispatch of the latest command
+    if (cmdTime>=0.0)
+    {
+        stats.addLatency(t1-cmdTime);
+        cmdTime=-1.0;
+    }
+
+    stats.addTick(t0,t1);
+
+    if ((diagPort.getOutputCount()>0) && (t0-lastDiag>=diagPeriod))
+    {
+        Bottle &diag=diagPort.prepare();
+        diag.clear();
+        statsToBottle(diag);
+        diagPort.write();
+        lastDiag=t0;
     }
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::publish(const Vector &state, Stamp &stamp,
+                                   const unsigned int seq, const unsigned int ack)
+{
+    // the sensors are corrupted on the way out, so that the
+    // plant, the estimators and the log keep the true state
+    Vector &out=stateOut;
+    out=state;
+    stateFaults.corrupt(out,vel.length());
 
-    statePort.prepare()=motors->integrate(vel);
+    size_t n=vel.length();
+    Vector &pos=statePort.prepare();
+    if (pos.length()!=n)
+        pos.resize(n);
+    for (size_t i=0; i<n; i++)
+        pos[i]=out[i];
+    statePort.setEnvelope(stamp);
     statePort.write();
 
+    if (stateExtPort.getOutputCount()>0)
+    {
+        stateExtPort.prepare()=out;
+        stateExtPort.setEnvelope(stamp);
+        stateExtPort.write();
+    }
+
+    if (peers>0)
+        snapshot.write(out,stamp,Time::now());
+
+    publishBinary(stateBinPort,out,stamp,seq,ack,false);
+    publishBinary(stateBin32Port,out,stamp,seq,ack,true);
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::publishBinary(BufferedPort<fakeMotorFrame> &port,
+                                         const Vector &state, Stamp &stamp,
+                                         const unsigned int seq, const unsigned int ack,
+                                         const bool f32)
+{
+    if (port.getOutputCount()>0)
+    {
+        fakeMotorFrame &frame=port.prepare();
+        frame.set(state,seq,f32);
+        frame.setAck(ack);
+        frame.setGen(generation);
+        port.setEnvelope(stamp);
+        port.write();
+    }
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::statsToBottle(Bottle &b) const
+{
+    stats.toBottle(b);
+
+    Bottle &f=b.addList();
+    f.addString("faults");
+    Bottle &fs=f.addList(); fs.addString("state"); stateFaults.toBottle(fs);
+    Bottle &fc=f.addList(); fc.addString("cmd");   cmdFaults.toBottle(fc);
+
+    Bottle &s=b.addList();
+    s.addString("sessions");
+    sessions.toBottle(s);
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::offerCommand(fakeMotorSession &s, const Vector &sp,
+                                         const double dispatchTime, const double t,
+                                         const unsigned int seq, const int flags)
+{
+    // in fifo the stale commands are skipped in favor of the
+    // following ones, whereas in latest-wins only the newest
+    // one undergoes the check once the queues are drained
+    if (cmdFifo && (cmdMaxAge>0.0) && (t-dispatchTime>cmdMaxAge))
+    {
+        stats.count(fakeMotorStats::STALE);
+        return;
+    }
+
+    // the command pending within the same tick is superseded
+    if (s.pending)
+        stats.count(fakeMotorStats::COALESCED);
+
+    for (size_t i=0; i<s.next.length(); i++)
+        s.next[i]=sp[i];
+
+    s.nextTime=dispatchTime;
+    s.nextSeq=seq;
+    s.nextFlags=flags;
+    s.pending=true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::applyCommand(fakeMotorSession &s, const double t)
+{
+    if (!s.pending)
+        return false;
+
+    s.pending=false;
+
+    // commands older than the max age are discarded
+    if ((cmdMaxAge>0.0) && (t-s.nextTime>cmdMaxAge))
+    {
+        stats.count(fakeMotorStats::STALE);
+        return false;
+    }
+
+    if (t-s.nextTime>motors.getTs())
+        stats.count(fakeMotorStats::LATE);
+
+    for (size_t i=0; i<s.sp.length(); i++)
+        s.sp[i]=s.next[i];
+
+    s.lastCmdTime=s.nextTime;
+    s.active=true;
+    s.applied=true;
+
+    cmdTime=(s.nextFlags&CMD_STAMPED)?s.nextTime:-1.0;
+    if (s.nextFlags&CMD_BINARY)
+        cmdAck=s.nextSeq;
+
+    if (recorder!=NULL)
+        recorder->write(fakeMotorLog::COMMAND,t,s.id,s.nextSeq,s.sp);
+
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::readSession(fakeMotorSession &s, const double t)
+{
+    // the in-process sessions come without ports
+    if (s.cmdPort==NULL)
+        return;
+
+    // latest-wins: all the pending commands are drained and only
+    // the newest is kept; fifo: the oldest fresh one is kept
+    unsigned int dropped=s.cmdPort->takeDropped()+s.cmdBinPort->takeDropped();
+    if (dropped>0)
+        stats.count(fakeMotorStats::DROPPED,dropped);
+
+    // the streaming command carries the setpoints of all the axes
+    // within one single message: [vel] [mmov] v_0 ... v_n-1;
+    // a plain list of velocities is still accepted as well
+    Stamp info;
+    while (!(cmdFifo && s.pending) && s.cmdPort->pop(cmdIn,info))
+    {
+        Bottle *cmd=&cmdIn;
+
+        int offset=0;
+        if ((cmd->get(0).asVocab()==Vocab::encode("vel")) &&
+            (cmd->get(1).asVocab()==Vocab::encode("mmov")))
+            offset=2;
+
+        if ((size_t)(cmd->size()-offset)>=vel.length())
+        {
+            for (size_t i=0; i<vel.length(); i++)
+                cmdBuf[i]=cmd->get(offset+i).asDouble();
+
+            s.cmds++;
+            s.rateCount++;
+            stats.addCommand();
+
+            // without envelope the command is deemed just sent
+            double dispatchTime=info.isValid()?info.getTime():t;
+            unsigned int seq=info.isValid()?(unsigned int)info.getCount():0;
+            int flags=info.isValid()?CMD_STAMPED:0;
+            if (cmdFaults.isEnabled())
+                cmdFaults.push(cmdBuf,dispatchTime,seq,(s.id<<2)|flags,t);
+            else
+                offerCommand(s,cmdBuf,dispatchTime,t,seq,flags);
+        }
+    }
+
+    // the same command in the binary format, whose envelope
+    // carries the time of dispatch; being drained afterwards,
+    // it supersedes the textual one within the same tick
+    while (!(cmdFifo && s.pending) && s.cmdBinPort->pop(cmdBinIn,info))
+    {
+        fakeMotorFrame *cmd=&cmdBinIn;
+
+        // the loop statistics count the commands of all the sessions
+        // but the losses of the default session only, whereas the
+        // others keep track of their own losses
+        unsigned int seq=cmd->getSeq();
+        if (sessions.isDefault(s))
+            stats.addCommand(seq);
+        else
+            stats.addCommand();
+        if ((s.lastSeq!=0) && (seq>s.lastSeq+1))
+            s.lost+=seq-s.lastSeq-1;
+        s.lastSeq=seq;
+
+        if (cmd->get().length()<vel.length())
+            continue;
+
+        s.cmds++;
+        s.rateCount++;
+
+        double dispatchTime=info.isValid()?info.getTime():t;
+        int flags=CMD_BINARY|(info.isValid()?CMD_STAMPED:0);
+        if (cmdFaults.isEnabled())
+            cmdFaults.push(cmd->get(),dispatchTime,seq,(s.id<<2)|flags,t);
+        else
+            offerCommand(s,cmd->get(),dispatchTime,t,seq,flags);
+    }
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::readCommands(const double t)
+{
+    for (size_t k=0; k<sessions.size(); k++)
+    {
+        sessions[k].applied=false;
+        readSession(sessions[k],t);
+    }
+
+    // the commands in flight are delivered in order of arrival
+    // and then undergo the same policy (in fifo, one command in
+    // flight is delivered per tick)
+    if (cmdFaults.isEnabled())
+    {
+        const fakeMotorFaults::Packet *packet;
+        bool delivered=false;
+        while (!(cmdFifo && delivered) && ((packet=cmdFaults.pop(t))!=NULL))
+        {
+            // the session might have been closed meanwhile
+            fakeMotorSession *s=sessions.find(packet->tag>>2);
+            if (s==NULL)
+                continue;
+
+            offerCommand(*s,packet->data,packet->time,t,packet->seq,packet->tag&0x03);
+            delivered=s->pending;
+        }
+    }
+
+    // one command per session at most gets applied
+    for (size_t k=0; k<sessions.size(); k++)
+        applyCommand(sessions[k],t);
+
+    bool changed=false;
+    for (size_t k=0; k<sessions.size(); k++)
+    {
+        fakeMotorSession &s=sessions[k];
+        changed|=s.applied;
+
+        // the joints of a stalled session are released, which
+        // means they are stopped unless someone else drives them
+        if ((cmdMaxAge>0.0) && s.active && (t-s.lastCmdTime>cmdMaxAge))
+        {
+            s.active=false;
+            stats.count(fakeMotorStats::TIMEOUT);
+            changed=true;
+        }
+
+        // the rates of the commands are updated every second
+        if (t-s.rateTime>=1.0)
+        {
+            s.rate=s.rateCount/(t-s.rateTime);
+            s.rateCount=0;
+            s.rateTime=t;
+        }
+    }
+
+    if (changed)
+        sessions.arbitrate(vel);
+
+    return changed;
+}
+
+/**********************************************************/
+int fakeMotorDeviceServer::openSession(const string &name, const int priority,
+                                       const vector<int> &joints, const bool ports)
+{
+    if (!configured)
+        return -1;
+
+    return sessions.open(name,priority,joints,ports);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::closeSession(const string &name)
+{
+    return sessions.close(name,vel);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::sessionMove(const int id, const double *sp)
+{
+    fakeMotorSession *s=sessions.find(id);
+    if (!configured || (s==NULL) || (sp==NULL))
+        return false;
+
+    for (size_t i=0; i<s->sp.length(); i++)
+        s->sp[i]=sp[i];
+
+    s->lastCmdTime=Time::now();
+    s->active=true;
+    s->cmds++;
+    s->rateCount++;
+    sessions.arbitrate(vel);
+
+    // the command is dispatched right now
+    stats.addCommand();
+    cmdTime=s->lastCmdTime;
+
+    if (recorder!=NULL)
+        recorder->write(fakeMotorLog::COMMAND,cmdTime,s->id,s->cmds,s->sp);
+
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::respondRpc(const Bottle &cmd, Bottle &reply)
+{
+    int codeMethod=cmd.get(1).asVocab();
+
+    // [rpc] [open]: a reply port <local>/rpc_async/<channel>:o is
+    // opened for the caller, who connects it to its own input and
+    // tags the requests with the channel
+    if (codeMethod==Vocab::encode("open"))
+    {
+        rpcReplyMutex.wait();
+        int channel=++rpcReplyIds;
+        rpcReplyMutex.post();
+
+        ostringstream port;
+        port<<name<<"/rpc_async/"<<channel<<":o";
+
+        BufferedPort<Bottle> *replyPort=new BufferedPort<Bottle>;
+        if (replyPort->open(port.str().c_str()))
+        {
+            replyPort->setStrict();
+
+            rpcReplyMutex.wait();
+            rpcReplyPorts[channel]=replyPort;
+            rpcReplyMutex.post();
+
+            reply.addVocab(Vocab::encode("ack"));
+            reply.addInt(channel);
+            reply.addString(port.str().c_str());
+        }
+        else
+            delete replyPort;
+    }
+    // [rpc] [close] <channel>
+    else if (codeMethod==Vocab::encode("close"))
+    {
+        rpcReplyMutex.wait();
+        BufferedPort<Bottle> *replyPort=NULL;
+        map<int,BufferedPort<Bottle>*>::iterator it=rpcReplyPorts.find(cmd.get(2).asInt());
+        if (it!=rpcReplyPorts.end())
+        {
+            replyPort=it->second;
+            rpcReplyPorts.erase(it);
+        }
+        rpcReplyMutex.post();
+
+        if (replyPort!=NULL)
+        {
+            replyPort->interrupt();
+            replyPort->close();
+            delete replyPort;
+            reply.addVocab(Vocab::encode("ack"));
+        }
+    }
+
+    if (reply.size()==0)
+        reply.addVocab(Vocab::encode("nack"));
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::replay(Vector &state)
+{
+    // in lock-step mode the log is played one state per tick, whereas
+    // otherwise the states are paced by their recorded time, so that
+    // replay_speed holds whatever the scheduler; the replay starts
+    // over when looped, otherwise the last state is held at the end
+    bool paced=!lockstep;
+    double elapsed=0.0;
+    if (paced)
+    {
+        double now=Time::now();
+        if (replayWall0<0.0)
+            replayWall0=now;
+        elapsed=replaySpeed*(now-replayWall0);
+    }
+
+    const double *data=NULL;
+    bool restarted=false;
+    for (size_t i=replayIdx; ; i++)
+    {
+        if (i>=player->size())
+        {
+            if (!replayLoop || restarted)
+                break;
+
+            i=0;
+            restarted=true;
+            replayIdx=0;
+            replayWall0=Time::now();
+            elapsed=0.0;
+        }
+
+        int kind,session; double t; unsigned int seq;
+        const double *record=player->get(i,kind,t,session,seq);
+        if (kind==fakeMotorLog::STATE)
+        {
+            // not yet due
+            if (paced && (t-replayT0>elapsed))
+                break;
+
+            data=record;
+            replayIdx=i+1;
+            replayLast=i;
+
+            if (!paced)
+                break;
+        }
+    }
+
+    if (data==NULL)
+    {
+        int kind,session; double t; unsigned int seq;
+        if ((data=player->get(replayLast,kind,t,session,seq))==NULL)
+            return false;
+    }
+
+    // the plant is kept aligned with the replayed state
+    size_t n=vel.length();
+    for (size_t i=0; i<n; i++)
+    {
+        state[i]=data[i];
+        state[n+i]=speeds[i]=data[n+i];
+        state[2*n+i]=accels[i]=data[2*n+i];
+        motors.set((int)i,data[i]);
+    }
+
+    return true;
+}
+
+/**********************************************************/
+fakeMotorDeviceServer *fakeMotorDeviceServer::attach(const string &name)
+{
+    registryMutex().wait();
+    fakeMotorDeviceServer *server=NULL;
+    map<string,fakeMotorDeviceServer*>::iterator it=registry().find(name);
+    if (it!=registry().end())
+    {
+        server=it->second;
+        server->peers++;
+    }
+    registryMutex().post();
+
+    return server;
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::detach()
+{
+    registryMutex().wait();
+    if (peers>0)
+        peers--;
+    registryMutex().post();
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::run()
+{
+    mutex.wait();
+    advance();
     mutex.post();
 }
 
+/**********************************************************/
+bool fakeMotorDeviceServer::TickReader::read(ConnectionReader &connection)
+{
+    Bottle cmd,reply;
+    cmd.read(connection);
+
+    // [tick] <n>
+    if ((owner!=NULL) && (cmd.get(0).asVocab()==Vocab::encode("tick")))
+    {
+        int n=(cmd.size()>1)?cmd.get(1).asInt():1;
+        double t;
+        if (owner->tick(n) && owner->getSimTime(&t))
+        {
+            reply.addVocab(Vocab::encode("ack"));
+            reply.addDouble(t);
+        }
+    }
+
+    if (reply.size()==0)
+        reply.addVocab(Vocab::encode("nack"));
+
+    if (ConnectionWriter *returnToSender=connection.getWriter())
+        reply.write(*returnToSender);
+
+    return true;
+}
+
 /**********************************************************/
 bool fakeMotorDeviceServer::read(ConnectionReader &connection)
-{        
+{
     Bottle cmd,reply;
     cmd.read(connection);
-    
-    mutex.wait();
 
+    respond(cmd,reply);
+
+    if (ConnectionWriter *returnToSender=connection.getWriter())
+        reply.write(*returnToSender);
+
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::RpcAsyncPort::onRead(Bottle &cmd)
+{
+    // [channel] [id] <request> is answered on the reply port of
+    // the channel as [channel] [id] <reply>, letting many requests
+    // be in flight; requests on unknown channels are dropped
+    if (owner!=NULL)
+    {
+        Bottle request=cmd.tail().tail();
+        Bottle reply;
+        owner->respond(request,reply);
+
+        owner->rpcReplyMutex.wait();
+        map<int,BufferedPort<Bottle>*>::iterator it=owner->rpcReplyPorts.find(cmd.get(0).asInt());
+        if (it!=owner->rpcReplyPorts.end())
+        {
+            Bottle &out=it->second->prepare();
+            out.clear();
+            out.add(cmd.get(0));
+            out.add(cmd.get(1));
+            out.append(reply);
+            it->second->writeStrict();
+        }
+        owner->rpcReplyMutex.post();
+    }
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::respond(const Bottle &cmd, Bottle &reply)
+{
     int codeIF=cmd.get(0).asVocab();
     int codeMethod=cmd.get(1).asVocab();
 
+    if (codeIF==Vocab::encode("sess"))
+    {
+        sessions.respond(cmd,reply,vel);
+        return;
+    }
+    else if (codeIF==Vocab::encode("rpc"))
+    {
+        respondRpc(cmd,reply);
+        return;
+    }
+
+    mutex.wait();
+
     if (codeIF==Vocab::encode("lim"))
     {
         if (codeMethod==Vocab::encode("get"))
@@ -146,6 +1025,14 @@ bool fakeMotorDeviceServer::read(ConnectionReader &connection)
                 reply.addDouble(max);
             }
         }
+        else if (codeMethod==Vocab::encode("set"))
+        {
+            int axis=cmd.get(2).asInt();
+            double min=cmd.get(3).asDouble();
+            double max=cmd.get(4).asDouble();
+            if (setLimits(axis,min,max))
+                reply.addVocab(Vocab::encode("ack"));
+        }
     }
     else if (codeIF==Vocab::encode("enc"))
     {
@@ -158,6 +1045,83 @@ bool fakeMotorDeviceServer::read(ConnectionReader &connection)
                 reply.addInt(ax);
             }
         }
+        else if (codeMethod==Vocab::encode("set"))
+        {
+            int axis=cmd.get(2).asInt();
+            double val=cmd.get(3).asDouble();
+            if (setEncoder(axis,val))
+                reply.addVocab(Vocab::encode("ack"));
+        }
+        else if (codeMethod==Vocab::encode("sets"))
+        {
+            if ((size_t)(cmd.size()-2)>=vel.length())
+            {
+                Vector vals(vel.length());
+                for (size_t i=0; i<vals.length(); i++)
+                    vals[i]=cmd.get(2+i).asDouble();
+
+                if (setEncoders(vals.data()))
+                    reply.addVocab(Vocab::encode("ack"));
+            }
+        }
+        else if (codeMethod==Vocab::encode("rst"))
+        {
+            int axis=cmd.get(2).asInt();
+            if (resetEncoder(axis))
+                reply.addVocab(Vocab::encode("ack"));
+        }
+        else if (codeMethod==Vocab::encode("rsts"))
+        {
+            if (resetEncoders())
+                reply.addVocab(Vocab::encode("ack"));
+        }
+        else if (codeMethod==Vocab::encode("pub"))
+        {
+            // the latest state is published again for the readers
+            // connected in between two ticks
+            publish(stateBuf,stamp,ticks,cmdAck);
+            reply.addVocab(Vocab::encode("ack"));
+        }
+    }
+    else if (codeIF==Vocab::encode("sim"))
+    {
+        if (codeMethod==Vocab::encode("time"))
+        {
+            double t;
+            if (getSimTime(&t))
+            {
+                reply.addVocab(Vocab::encode("ack"));
+                reply.addDouble(t);
+            }
+        }
+        else if (codeMethod==Vocab::encode("gen"))
+        {
+            reply.addVocab(Vocab::encode("ack"));
+            reply.addInt((int)generation);
+        }
+    }
+    else if (codeIF==Vocab::encode("stat"))
+    {
+        if (codeMethod==Vocab::encode("get"))
+        {
+            reply.addVocab(Vocab::encode("ack"));
+            statsToBottle(reply);
+        }
+        else if (codeMethod==Vocab::encode("rst"))
+        {
+            stats.reset();
+            stateFaults.reset();
+            cmdFaults.reset();
+            reply.addVocab(Vocab::encode("ack"));
+        }
+    }
+    else if (codeIF==Vocab::encode("wire"))
+    {
+        // [wire] [bin]: the client checks whether the binary format
+        // is supported, then picks the precision of the state by
+        // connecting to either state_bin:o or state_bin32:o
+        if (codeMethod==Vocab::encode("bin"))
+            reply.addVocab(Vocab::encode("ack"));
     }
     else if (codeIF==Vocab::encode("vel"))
     {
@@ -175,6 +1139,25 @@ bool fakeMotorDeviceServer::read(ConnectionReader &connection)
             if (setRefAcceleration(axis,acc))
                 reply.addVocab(Vocab::encode("ack"));
         }
+        else if (codeMethod==Vocab::encode("macc"))
+        {
+            if ((size_t)(cmd.size()-2)>=vel.length())
+            {
+                Vector acc(vel.length());
+                for (size_t i=0; i<acc.length(); i++)
+                    acc[i]=cmd.get(2+i).asDouble();
+
+                if (setRefAccelerations(acc.data()))
+                    reply.addVocab(Vocab::encode("ack"));
+            }
+        }
+        else if (codeMethod==Vocab::encode("gacc"))
+        {
+            const Vector &acc=motors.getAcc();
+            reply.addVocab(Vocab::encode("ack"));
+            for (size_t i=0; i<acc.length(); i++)
+                reply.addDouble(acc[i]);
+        }
         else if (codeMethod==Vocab::encode("stop"))
         {
             int axis=cmd.get(2).asInt();
@@ -187,11 +1170,6 @@ bool fakeMotorDeviceServer::read(ConnectionReader &connection)
         reply.addVocab(Vocab::encode("nack"));
 
     mutex.post();
-
-    if (ConnectionWriter *returnToSender=connection.getWriter())
-        reply.write(*returnToSender);
-
-    return true;
 }
 
 /**********************************************************/
@@ -200,9 +1178,9 @@ bool fakeMotorDeviceServer::getLimits(int axis, double *min, double *max)
     if (!configured)
         return false;
 
-    if ((axis<(int)motors->get().length()) && (min!=NULL) && (max!=NULL))
+    if ((axis>=0) && (axis<(int)motors.getAxes()) && (min!=NULL) && (max!=NULL))
     {
-        Matrix lim=motors->getLim();
+        const Matrix &lim=motors.getLim();
         *min=lim(axis,0); *max=lim(axis,1);
         return true;
     }
@@ -210,6 +1188,17 @@ bool fakeMotorDeviceServer::getLimits(int axis, double *min, double *max)
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceServer::setLimits(int axis, double min, double max)
+{
+    if (!configured || !motors.setLim(axis,min,max))
+        return false;
+
+    if (++generation==0)
+        generation=1;
+    return true;
+}
+
 /**********************************************************/
 bool fakeMotorDeviceServer::getAxes(int *ax)
 {
@@ -218,13 +1207,120 @@ bool fakeMotorDeviceServer::getAxes(int *ax)
 
     if (ax!=NULL)
     {
-        *ax=(int)motors->get().length();
+        *ax=(int)motors.getAxes();
         return true;
     }
     else
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoder(int j, double *v)
+{
+    if (!configured || (v==NULL) || (j<0) || ((size_t)j>=vel.length()))
+        return false;
+
+    *v=motors.get()[j];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoders(double *encs)
+{
+    if (!configured || (encs==NULL))
+        return false;
+
+    const Vector &pos=motors.get();
+    for (size_t i=0; i<pos.length(); i++)
+        encs[i]=pos[i];
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setEncoder(int j, double val)
+{
+    if (!configured || !motors.set(j,val))
+        return false;
+
+    // the estimators would otherwise see the jump
+    estimator.reset(motors.get());
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setEncoders(const double *vals)
+{
+    if (!configured || (vals==NULL))
+        return false;
+
+    for (size_t i=0; i<vel.length(); i++)
+        motors.set((int)i,vals[i]);
+
+    estimator.reset(motors.get());
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::resetEncoder(int j)
+{
+    return setEncoder(j,0.0);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::resetEncoders()
+{
+    if (!configured)
+        return false;
+
+    Vector zeros(vel.length(),0.0);
+    return setEncoders(zeros.data());
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderSpeed(int j, double *sp)
+{
+    if (!configured || (sp==NULL) || (j<0) || ((size_t)j>=speeds.length()))
+        return false;
+
+    *sp=speeds[j];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderSpeeds(double *spds)
+{
+    if (!configured || (spds==NULL))
+        return false;
+
+    for (size_t i=0; i<speeds.length(); i++)
+        spds[i]=speeds[i];
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderAcceleration(int j, double *acc)
+{
+    if (!configured || (acc==NULL) || (j<0) || ((size_t)j>=accels.length()))
+        return false;
+
+    *acc=accels[j];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderAccelerations(double *accs)
+{
+    if (!configured || (accs==NULL))
+        return false;
+
+    for (size_t i=0; i<accels.length(); i++)
+        accs[i]=accels[i];
+
+    return true;
+}
+
 /**********************************************************/
 bool fakeMotorDeviceServer::velocityMove(int j, double sp)
 {
@@ -233,27 +1329,123 @@ bool fakeMotorDeviceServer::velocityMove(int j, double sp)
 
     if ((size_t)j<vel.length())
     {
-        vel[j]=sp;
+        fakeMotorSession &s=sessions.getDefault();
+        s.sp[j]=sp;
+        s.lastCmdTime=Time::now();
+        s.active=true;
+        s.cmds++;
+        s.rateCount++;
+        sessions.arbitrate(vel);
+
+        stats.addCommand();
+        cmdTime=s.lastCmdTime;
+
+        if (recorder!=NULL)
+            recorder->write(fakeMotorLog::COMMAND,cmdTime,s.id,s.cmds,s.sp);
         return true;
     }
     else
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceServer::velocityMove(const double *sp)
+{
+    if (!configured || (sp==NULL))
+        return false;
+
+    return sessionMove(sessions.getDefault().id,sp);
+}
+
 /**********************************************************/
 bool fakeMotorDeviceServer::setRefAcceleration(int j, double acc)
 {
-    if (configured && ((size_t)j<vel.length()))
-        return true;
+    if (configured)
+        return motors.setRefAcceleration(j,acc);
     else
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceServer::setRefAccelerations(const double *accs)
+{
+    if (!configured || (accs==NULL))
+        return false;
+
+    for (size_t i=0; i<vel.length(); i++)
+        if (!setRefAcceleration((int)i,accs[i]))
+            return false;
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAcceleration(int j, double *acc)
+{
+    if (!configured || (acc==NULL) || (j<0) || ((size_t)j>=vel.length()))
+        return false;
+
+    *acc=motors.getAcc()[j];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAccelerations(double *accs)
+{
+    if (!configured || (accs==NULL))
+        return false;
+
+    const Vector &acc=motors.getAcc();
+    for (size_t i=0; i<acc.length(); i++)
+        accs[i]=acc[i];
+
+    return true;
+}
+
 /**********************************************************/
 bool fakeMotorDeviceServer::stop(int j)
 {
     return velocityMove(j,0.0);
 }
 
+/**********************************************************/
+bool fakeMotorDeviceServer::stop()
+{
+    if (!configured)
+        return false;
+
+    sessions.getDefault().sp=0.0;
+    sessions.arbitrate(vel);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::tick(const int n)
+{
+    if (!configured || !external || (n<=0))
+        return false;
+
+    mutex.wait();
+    for (int i=0; i<n; i++)
+        advance();
+    double t=ticks*motors.getTs();
+    mutex.post();
+
+    publishFakeMotorClock(clockPort,t);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getSimTime(double *t)
+{
+    if (!configured || (t==NULL))
+        return false;
+
+    mutex.wait();
+    *t=ticks*motors.getTs();
+    mutex.post();
+
+    return true;
+}
 
 
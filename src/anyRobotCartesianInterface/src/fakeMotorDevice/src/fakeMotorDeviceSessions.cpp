@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <private/fakeMotorDeviceSessions.h>
+
+#include <stdio.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+
+/**********************************************************/
+void fakeMotorSession::init(const string &name, const int id,
+                            const int priority, const vector<bool> &mask)
+{
+    this->name=name;
+    this->id=id;
+    this->priority=priority;
+    this->mask=mask;
+    cmdPort=NULL;
+    cmdBinPort=NULL;
+    sp.resize(mask.size(),0.0);
+    sp=0.0;
+    lastCmdTime=-1.0;
+    next.resize(mask.size(),0.0);
+    nextTime=-1.0;
+    nextSeq=0;
+    nextFlags=0;
+    pending=false;
+    active=false;
+    applied=false;
+    lastSeq=0;
+    cmds=lost=0;
+    rateCount=0;
+    rateTime=Time::now();
+    rate=0.0;
+}
+
+/**********************************************************/
+void fakeMotorSession::toBottle(Bottle &b) const
+{
+    Bottle &n=b.addList(); n.addString("name");     n.addString(name.c_str());
+    Bottle &i=b.addList(); i.addString("id");       i.addInt(id);
+    Bottle &p=b.addList(); p.addString("priority"); p.addInt(priority);
+
+    Bottle &j=b.addList(); j.addString("joints");
+    for (size_t k=0; k<mask.size(); k++)
+        if (mask[k])
+            j.addInt((int)k);
+
+    Bottle &a=b.addList(); a.addString("active");   a.addInt(active?1:0);
+    Bottle &c=b.addList(); c.addString("commands"); c.addInt((int)cmds);
+    Bottle &l=b.addList(); l.addString("lost");     l.addInt((int)lost);
+    Bottle &r=b.addList(); r.addString("rate");     r.addDouble(rate);
+}
+
+/**********************************************************/
+fakeMotorSessions::fakeMotorSessions(Semaphore &mutex) : mutex(mutex)
+{
+    queue=100;
+    ids=0;
+}
+
+/**********************************************************/
+void fakeMotorSessions::configure(const string &prefix, const size_t axes, const size_t queue,
+                                  fakeMotorInbox<Bottle> *cmdPort,
+                                  fakeMotorInbox<fakeMotorFrame> *cmdBinPort)
+{
+    this->prefix=prefix;
+    this->queue=queue;
+
+    defaultSession.init("default",0,0,vector<bool>(axes,true));
+    defaultSession.cmdPort=cmdPort;
+    defaultSession.cmdBinPort=cmdBinPort;
+    sessions.assign(1,&defaultSession);
+    ids=0;
+}
+
+/**********************************************************/
+void fakeMotorSessions::release(fakeMotorSession *s)
+{
+    if (s->cmdPort!=NULL)
+    {
+        s->cmdPort->interrupt();
+        s->cmdBinPort->interrupt();
+        s->cmdPort->close();
+        s->cmdBinPort->close();
+        delete s->cmdPort;
+        delete s->cmdBinPort;
+    }
+
+    delete s;
+}
+
+/**********************************************************/
+int fakeMotorSessions::open(const string &name, const int priority,
+                            const vector<int> &joints, const bool ports)
+{
+    if (name.empty() || sessions.empty())
+        return -1;
+
+    vector<bool> mask(defaultSession.mask.size(),joints.empty());
+    for (size_t i=0; i<joints.size(); i++)
+    {
+        if ((joints[i]<0) || ((size_t)joints[i]>=mask.size()))
+        {
+            printf("Error: session \"%s\" refers to the unknown joint %d\n",
+                   name.c_str(),joints[i]);
+            return -1;
+        }
+
+        mask[joints[i]]=true;
+    }
+
+    fakeMotorSession *s=new fakeMotorSession;
+    s->init(name,-1,priority,mask);
+
+    if (ports)
+    {
+        s->cmdPort=new fakeMotorInbox<Bottle>(queue);
+        s->cmdBinPort=new fakeMotorInbox<fakeMotorFrame>(queue);
+        s->cmdPort->open((prefix+"/"+name+"/cmd:i").c_str());
+        s->cmdBinPort->open((prefix+"/"+name+"/cmd_bin:i").c_str());
+    }
+
+    mutex.wait();
+    bool unique=(find(name)==NULL);
+    if (unique)
+    {
+        s->id=++ids;
+        sessions.push_back(s);
+    }
+    mutex.post();
+
+    if (unique)
+    {
+        printf("Session \"%s\" opened with priority %d\n",name.c_str(),priority);
+        return s->id;
+    }
+
+    printf("Error: session \"%s\" already open\n",name.c_str());
+    release(s);
+    return -1;
+}
+
+/**********************************************************/
+bool fakeMotorSessions::close(const string &name, Vector &vel)
+{
+    fakeMotorSession *s=NULL;
+
+    mutex.wait();
+    for (size_t k=1; k<sessions.size(); k++)
+    {
+        if (sessions[k]->name==name)
+        {
+            s=sessions[k];
+            sessions.erase(sessions.begin()+k);
+            arbitrate(vel);
+            break;
+        }
+    }
+    mutex.post();
+
+    if (s==NULL)
+        return false;
+
+    release(s);
+
+    printf("Session \"%s\" closed\n",name.c_str());
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorSessions::clear()
+{
+    for (size_t k=1; k<sessions.size(); k++)
+        release(sessions[k]);
+
+    sessions.clear();
+}
+
+/**********************************************************/
+fakeMotorSession *fakeMotorSessions::find(const int id)
+{
+    for (size_t k=0; k<sessions.size(); k++)
+        if (sessions[k]->id==id)
+            return sessions[k];
+
+    return NULL;
+}
+
+/**********************************************************/
+fakeMotorSession *fakeMotorSessions::find(const string &name)
+{
+    for (size_t k=0; k<sessions.size(); k++)
+        if (sessions[k]->name==name)
+            return sessions[k];
+
+    return NULL;
+}
+
+/**********************************************************/
+void fakeMotorSessions::arbitrate(Vector &vel) const
+{
+    for (size_t j=0; j<vel.length(); j++)
+    {
+        const fakeMotorSession *owner=NULL;
+        for (size_t k=0; k<sessions.size(); k++)
+        {
+            const fakeMotorSession *s=sessions[k];
+            if (s->active && s->mask[j] &&
+                ((owner==NULL) || (s->priority>owner->priority) ||
+                 ((s->priority==owner->priority) && (s->lastCmdTime>owner->lastCmdTime))))
+                owner=s;
+        }
+
+        vel[j]=(owner!=NULL)?owner->sp[j]:0.0;
+    }
+}
+
+/**********************************************************/
+void fakeMotorSessions::respond(const Bottle &cmd, Bottle &reply, Vector &vel)
+{
+    int codeMethod=cmd.get(1).asVocab();
+    string name=cmd.get(2).asString().c_str();
+
+    // [sess] [open] <name> <priority> (<joints>)
+    if (codeMethod==Vocab::encode("open"))
+    {
+        vector<int> joints;
+        if (Bottle *list=cmd.get(4).asList())
+            for (int i=0; i<list->size(); i++)
+                joints.push_back(list->get(i).asInt());
+
+        int id=open(name,cmd.get(3).asInt(),joints);
+        if (id>=0)
+        {
+            reply.addVocab(Vocab::encode("ack"));
+            reply.addInt(id);
+        }
+    }
+    // [sess] [close] <name>
+    else if (codeMethod==Vocab::encode("close"))
+    {
+        if (close(name,vel))
+            reply.addVocab(Vocab::encode("ack"));
+    }
+    // [sess] [list]
+    else if (codeMethod==Vocab::encode("list"))
+    {
+        mutex.wait();
+        reply.addVocab(Vocab::encode("ack"));
+        for (size_t k=0; k<sessions.size(); k++)
+            sessions[k]->toBottle(reply.addList());
+        mutex.post();
+    }
+
+    if (reply.size()==0)
+        reply.addVocab(Vocab::encode("nack"));
+}
+
+/**********************************************************/
+void fakeMotorSessions::toBottle(Bottle &b) const
+{
+    for (size_t k=0; k<sessions.size(); k++)
+        sessions[k]->toBottle(b.addList());
+}
+
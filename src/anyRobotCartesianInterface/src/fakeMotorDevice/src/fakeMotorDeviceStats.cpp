@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <private/fakeMotorDeviceStats.h>
+
+#include <math.h>
+
+using namespace std;
+using namespace yarp::os;
+
+/**********************************************************/
+fakeMotorHistogram::fakeMotorHistogram() : lo(0.0), width(1.0)
+{
+    reset();
+}
+
+/**********************************************************/
+void fakeMotorHistogram::configure(const double lo, const double hi, const size_t n)
+{
+    this->lo=lo;
+    width=(hi>lo)&&(n>0)?(hi-lo)/n:1.0;
+    bins.assign(n>0?n:1,0);
+    reset();
+}
+
+/**********************************************************/
+void fakeMotorHistogram::add(const double x)
+{
+    if (x<lo)
+        under++;
+    else
+    {
+        size_t i=(size_t)floor((x-lo)/width);
+        if (i<bins.size())
+            bins[i]++;
+        else
+            over++;
+    }
+
+    if ((count==0) || (x<min))
+        min=x;
+    if ((count==0) || (x>max))
+        max=x;
+
+    sum+=x;
+    count++;
+}
+
+/**********************************************************/
+void fakeMotorHistogram::reset()
+{
+    for (size_t i=0; i<bins.size(); i++)
+        bins[i]=0;
+
+    under=over=count=0;
+    sum=min=max=0.0;
+}
+
+/**********************************************************/
+double fakeMotorHistogram::percentile(const double p) const
+{
+    if (count==0)
+        return 0.0;
+
+    // the samples out of range are placed at the extremes
+    double target=p*count;
+    double acc=under;
+    if (acc>=target)
+        return min;
+
+    for (size_t i=0; i<bins.size(); i++)
+    {
+        if (acc+bins[i]>=target)
+            return lo+width*(i+(target-acc)/bins[i]);
+
+        acc+=bins[i];
+    }
+
+    return max;
+}
+
+/**********************************************************/
+void fakeMotorHistogram::toBottle(Bottle &b) const
+{
+    Bottle &c=b.addList(); c.addString("count"); c.addInt((int)count);
+    Bottle &m=b.addList(); m.addString("mean");  m.addDouble(count>0?sum/count:0.0);
+    Bottle &l=b.addList(); l.addString("min");   l.addDouble(min);
+    Bottle &h=b.addList(); h.addString("max");   h.addDouble(max);
+    Bottle &p=b.addList(); p.addString("p50");   p.addDouble(percentile(0.5));
+    Bottle &q=b.addList(); q.addString("p99");   q.addDouble(percentile(0.99));
+    Bottle &u=b.addList(); u.addString("under"); u.addInt((int)under);
+    Bottle &o=b.addList(); o.addString("over");  o.addInt((int)over);
+    Bottle &s=b.addList(); s.addString("lo");    s.addDouble(lo);
+    Bottle &w=b.addList(); w.addString("width"); w.addDouble(width);
+
+    Bottle &v=b.addList();
+    v.addString("bins");
+    for (size_t i=0; i<bins.size(); i++)
+        v.addInt((int)bins[i]);
+}
+
+/**********************************************************/
+fakeMotorStats::fakeMotorStats() : Ts(10.0), tolerance(0.5)
+{
+    reset();
+}
+
+/**********************************************************/
+void fakeMotorStats::configure(const double Ts, const size_t bins, const double tolerance)
+{
+    this->Ts=Ts;
+    this->tolerance=tolerance;
+
+    period.configure(0.0,2.0*Ts,bins);
+    runTime.configure(0.0,Ts,bins);
+    latency.configure(0.0,10.0*Ts,bins);
+
+    reset();
+}
+
+/**********************************************************/
+void fakeMotorStats::addTick(const double t0, const double t1)
+{
+    if (lastTick>=0.0)
+    {
+        double dt=1000.0*(t0-lastTick);
+        period.add(dt);
+        if (dt>(1.0+tolerance)*Ts)
+            late++;
+    }
+
+    double run=1000.0*(t1-t0);
+    runTime.add(run);
+    if (run>Ts)
+        overruns++;
+
+    lastTick=t0;
+    ticks++;
+}
+
+/**********************************************************/
+void fakeMotorStats::addCommand(const unsigned int seq)
+{
+    // the gaps in the sequence account for the commands
+    // lost on the way or superseded by newer ones
+    if ((lastSeq!=0) && ((int)(seq-lastSeq)>1))
+        lost+=seq-lastSeq-1;
+
+    lastSeq=seq;
+    cmds++;
+}
+
+/**********************************************************/
+void fakeMotorStats::addCommand()
+{
+    cmds++;
+}
+
+/**********************************************************/
+void fakeMotorStats::addLatency(const double dt)
+{
+    latency.add(1000.0*dt);
+}
+
+/**********************************************************/
+void fakeMotorStats::count(const int event, const unsigned int n)
+{
+    if ((event>=0) && (event<(int)(sizeof(events)/sizeof(events[0]))))
+        events[event]+=n;
+}
+
+/**********************************************************/
+void fakeMotorStats::reset()
+{
+    period.reset();
+    runTime.reset();
+    latency.reset();
+
+    lastTick=-1.0;
+    ticks=late=overruns=0;
+    cmds=lost=lastSeq=0;
+    for (size_t i=0; i<sizeof(events)/sizeof(events[0]); i++)
+        events[i]=0;
+}
+
+/**********************************************************/
+void fakeMotorStats::toBottle(Bottle &b) const
+{
+    Bottle &t=b.addList(); t.addString("ticks");    t.addInt((int)ticks);
+    Bottle &l=b.addList(); l.addString("late");     l.addInt((int)late);
+    Bottle &o=b.addList(); o.addString("overruns"); o.addInt((int)overruns);
+    Bottle &c=b.addList(); c.addString("commands"); c.addInt((int)cmds);
+    Bottle &x=b.addList(); x.addString("lost");     x.addInt((int)lost);
+
+    Bottle &e0=b.addList(); e0.addString("coalesced");     e0.addInt((int)events[COALESCED]);
+    Bottle &e1=b.addList(); e1.addString("stale");         e1.addInt((int)events[STALE]);
+    Bottle &e2=b.addList(); e2.addString("late_commands"); e2.addInt((int)events[LATE]);
+    Bottle &e3=b.addList(); e3.addString("timeouts");      e3.addInt((int)events[TIMEOUT]);
+    Bottle &e4=b.addList(); e4.addString("dropped");       e4.addInt((int)events[DROPPED]);
+
+    Bottle &p=b.addList(); p.addString("period");  period.toBottle(p);
+    Bottle &r=b.addList(); r.addString("run");     runTime.toBottle(r);
+    Bottle &d=b.addList(); d.addString("latency"); latency.toBottle(d);
+}
+
@@ -0,0 +1,182 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <iostream>
+
+#include "fakeRobotLauncher.h"
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+using namespace fakeRobotModule;
+
+
+/**********************************************************/
+void Scheduler::run()
+{
+    for (size_t i=0; i<parts.size(); i++)
+        parts[i]->tick();
+}
+
+/**********************************************************/
+bool Ticker::read(ConnectionReader &connection)
+{
+    Bottle cmd,reply;
+    cmd.read(connection);
+
+    // [tick] <n>
+    if (cmd.get(0).asVocab()==Vocab::encode("tick"))
+    {
+        int n=(cmd.size()>1)?cmd.get(1).asInt():1;
+
+        bool ok=true;
+        for (size_t i=0; i<parts.size(); i++)
+            ok&=parts[i]->tick(n);
+
+        double t;
+        if (ok && parts[0]->getSimTime(&t))
+        {
+            publishFakeMotorClock(clockPort,t);
+
+            reply.addVocab(Vocab::encode("ack"));
+            reply.addDouble(t);
+        }
+    }
+
+    if (reply.size()==0)
+        reply.addVocab(Vocab::encode("nack"));
+
+    if (ConnectionWriter *returnToSender=connection.getWriter())
+        reply.write(*returnToSender);
+
+    return true;
+}
+
+/**********************************************************/
+void Ticker::open(const string &robot, ResourceFinder &rf)
+{
+    if (rf.check("clock"))
+        clockPort.open(rf.find("clock").asString().c_str());
+
+    tickPort.open(("/"+robot+"/tick:i").c_str());
+    tickPort.setReader(*this);
+}
+
+/**********************************************************/
+void Ticker::close()
+{
+    tickPort.interrupt();
+    clockPort.interrupt();
+
+    tickPort.close();
+    clockPort.close();
+}
+
+/**********************************************************/
+bool Launcher::configure(ResourceFinder &rf)
+{
+    Time::turboBoost();
+
+    string robot=rf.find("robot").asString().c_str();
+    int Ts=rf.check("Ts",Value(10)).asInt();
+
+    // in lock-step mode the parts are advanced only upon
+    // ticks received through the port /<robot>/tick:i
+    lockstep=(rf.check("lockstep",Value("off")).asString()=="on");
+
+    Bottle parts;
+    if (Bottle *list=rf.find("parts").asList())
+        parts=*list;
+    else
+        parts.addString(rf.find("part").asString().c_str());
+
+    for (int i=0; i<parts.size(); i++)
+    {
+        string part=parts.get(i).asString().c_str();
+
+        // the group named after the part describes its joints
+        Property options(rf.findGroup(part.c_str()).toString().c_str());
+        options.put("device","fakeyServer");
+        options.put("local",("/"+robot+"/"+part).c_str());
+        options.put("Ts",Ts);
+        options.put("lockstep",lockstep?"on":"off");
+        options.put("scheduler","external");
+
+        PolyDriver *driver=new PolyDriver;
+        drivers.push_back(driver);
+
+        IFakeMotorLockStep *step;
+        if (!driver->open(options) || !driver->view(step))
+        {
+            cout<<"Error: unable to simulate the part \""<<part<<"\""<<endl;
+            close();
+            return false;
+        }
+
+        if (lockstep)
+            ticker.add(step);
+        else
+        {
+            if (scheduler==NULL)
+                scheduler=new Scheduler(Ts);
+
+            scheduler->add(step);
+        }
+    }
+
+    if (drivers.size()==0)
+    {
+        cout<<"Error: no part to simulate"<<endl;
+        return false;
+    }
+
+    if (lockstep)
+        ticker.open(robot,rf);
+    else
+        scheduler->start();
+
+    return true;
+}
+
+/**********************************************************/
+bool Launcher::close()
+{
+    if (scheduler!=NULL)
+    {
+        if (scheduler->isRunning())
+            scheduler->stop();
+
+        delete scheduler;
+        scheduler=NULL;
+    }
+
+    if (lockstep)
+        ticker.close();
+
+    for (size_t i=0; i<drivers.size(); i++)
+    {
+        if (drivers[i]->isValid())
+            drivers[i]->close();
+
+        delete drivers[i];
+    }
+
+    drivers.clear();
+    return true;
+}
+
+
@@ -0,0 +1,105 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEROBOTLAUNCHER_H__
+#define __FAKEROBOTLAUNCHER_H__
+
+#include <string>
+#include <deque>
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+#include <fakeMotorDevice.h>
+
+namespace fakeRobotModule
+{
+
+/**
+ * This class steps all the parts of the fake robot from within one
+ * single thread, rather than letting each part run its own thread.
+ */
+class Scheduler: public yarp::os::RateThread
+{
+    std::deque<IFakeMotorLockStep*> parts;
+
+public:
+    /**********************************************************/
+    Scheduler(const int Ts) : RateThread(Ts) { }
+
+    /**********************************************************/
+    void add(IFakeMotorLockStep *part) { parts.push_back(part); }
+
+    void run();
+};
+
+/**
+ * This class forwards the ticks received in lock-step mode through
+ * the port /<robot>/tick:i to all the parts at once, publishing the
+ * simulated time on the port given by the "clock" option, if any.
+ */
+class Ticker: public yarp::os::PortReader
+{
+    std::deque<IFakeMotorLockStep*> parts;
+    yarp::os::BufferedPort<yarp::os::Bottle> clockPort;
+    yarp::os::Port tickPort;
+
+    bool read(yarp::os::ConnectionReader &connection);
+
+public:
+    /**********************************************************/
+    void add(IFakeMotorLockStep *part) { parts.push_back(part); }
+
+    void open(const std::string &robot, yarp::os::ResourceFinder &rf);
+
+    void close();
+};
+
+/**
+ * This container class launches the server part of the
+ * fake motor device in order to simulate a robot called
+ * "fake_robot" wiht the part "fake_part", whose actuated
+ * rotational joints are described in the configuration
+ * file (three joints by default).
+ *
+ * Many parts can be simulated at once by listing them in
+ * the "parts" option: each of them is described by the
+ * group named after the part.
+ */
+class Launcher: public yarp::os::RFModule
+{
+    std::deque<yarp::dev::PolyDriver*> drivers;
+    Scheduler *scheduler;
+    Ticker     ticker;
+    bool       lockstep;
+
+public:
+    /**********************************************************/
+    Launcher() : scheduler(NULL), lockstep(false) { }
+
+    bool configure(yarp::os::ResourceFinder &rf);
+
+    bool close();
+
+    /**********************************************************/
+    double getPeriod()    { return 1.0;  }
+    bool   updateModule() { return true; }
+};
+
+}
+
+#endif
+
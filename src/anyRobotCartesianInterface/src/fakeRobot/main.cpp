@@ -16,57 +16,17 @@
 */
 
 #include <yarp/os/all.h>
-#include <yarp/dev/all.h>
 #include <fakeMotorDevice.h>
+#include "fakeRobotLauncher.h"
 
 #include <iostream>
-#include <iomanip>
 
 using namespace std;
 using namespace yarp::os;
-using namespace yarp::dev;
-
-/**
- * This container class launches the server part of the
- * fake motor device in order to simulate a robot called
- * "fake_robot" wiht the part "fake_part" composed of three
- * actuated rotational joints.
- */
-class Launcher: public RFModule
-{
-    PolyDriver driver;
-
-public:
-    /**********************************************************/
-    bool configure(ResourceFinder &rf)
-    {
-        Time::turboBoost();
-
-        Property options;
-        options.put("device","fakeyServer");
-        options.put("local","/fake_robot/fake_part");
-
-        driver.open(options);
-        return driver.isValid();
-    }
-
-    /**********************************************************/
-    bool close()
-    {
-        if (driver.isValid())
-            driver.close();
-
-        return true;
-    }
-
-    /**********************************************************/
-    double getPeriod()    { return 1.0;  }
-    bool   updateModule() { return true; }
-};
-
+using namespace fakeRobotModule;
 
 /**********************************************************/
-int main()
+int main(int argc, char *argv[])
 {
     Network yarp;
     if (!yarp.checkNetwork())
@@ -79,8 +39,14 @@ int main()
     // for dealing with the fake robot
     registerFakeMotorDevices();
     
-    Launcher launcher;
     ResourceFinder rf;
+    rf.setVerbose(true);
+    rf.setDefaultConfigFile("fakeRobot.ini");
+    rf.setDefault("robot","fake_robot");
+    rf.setDefault("part","fake_part");
+    rf.configure(argc,argv);
+
+    Launcher launcher;
     return launcher.runModule(rf);
 }
 
@@ -0,0 +1,498 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <yarp/os/all.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+using namespace yarp::os;
+
+/**
+ * The DH description of the chain, angles in [rad].
+ */
+struct Kinematics
+{
+    vector<double> A,D,alpha,offset,min,max;
+    double H0[16];
+    double HN[16];
+};
+
+/**
+ * A term of the generated code: either a constant known at
+ * generation time, which lets the arithmetic be folded, or the
+ * name of a variable (possibly a whole expression).
+ */
+struct Expr
+{
+    bool   isConst;
+    double val;
+    string code;
+
+    Expr(const double val=0.0) : isConst(true), val(val) { }
+    Expr(const string &code) : isConst(false), val(0.0), code(code) { }
+};
+
+/**********************************************************/
+string literal(const double val)
+{
+    ostringstream str;
+    str<<setprecision(17)<<val;
+    string s=str.str();
+    if (s.find_first_of(".en")==string::npos)
+        s+=".0";
+
+    return s;
+}
+
+/**********************************************************/
+string text(const Expr &e)
+{
+    if (e.isConst)
+        return (e.val<0.0)?"("+literal(e.val)+")":literal(e.val);
+    else
+        return e.code;
+}
+
+/**********************************************************/
+Expr neg(const Expr &a)
+{
+    if (a.isConst)
+        return Expr(-a.val);
+    else
+        return Expr("(-"+a.code+")");
+}
+
+/**********************************************************/
+Expr mul(const Expr &a, const Expr &b)
+{
+    if (a.isConst && b.isConst)
+        return Expr(a.val*b.val);
+    else if ((a.isConst && (a.val==0.0)) || (b.isConst && (b.val==0.0)))
+        return Expr(0.0);
+    else if (a.isConst && (a.val==1.0))
+        return b;
+    else if (b.isConst && (b.val==1.0))
+        return a;
+    else if (a.isConst && (a.val==-1.0))
+        return neg(b);
+    else if (b.isConst && (b.val==-1.0))
+        return neg(a);
+    else
+        return Expr(text(a)+"*"+text(b));
+}
+
+/**********************************************************/
+Expr add(const Expr &a, const Expr &b)
+{
+    if (a.isConst && b.isConst)
+        return Expr(a.val+b.val);
+    else if (a.isConst && (a.val==0.0))
+        return b;
+    else if (b.isConst && (b.val==0.0))
+        return a;
+    else
+        return Expr("("+text(a)+"+"+text(b)+")");
+}
+
+/**********************************************************/
+Expr sub(const Expr &a, const Expr &b)
+{
+    if (a.isConst && b.isConst)
+        return Expr(a.val-b.val);
+    else if (b.isConst && (b.val==0.0))
+        return a;
+    else if (a.isConst && (a.val==0.0))
+        return neg(b);
+    else
+        return Expr("("+text(a)+"-"+text(b)+")");
+}
+
+/**
+ * Round the constants very close to 0 and +/-1, as those coming
+ * from the conversion of the angles in [deg], so that they fold.
+ */
+double snap(const double val)
+{
+    const double eps=1e-12;
+    if (fabs(val)<eps)
+        return 0.0;
+    else if (fabs(val-1.0)<eps)
+        return 1.0;
+    else if (fabs(val+1.0)<eps)
+        return -1.0;
+    else
+        return val;
+}
+
+/**
+ * This class emits the body computing the pose of the end-effector
+ * and, optionally, the geometric Jacobian. The frame is tracked
+ * through the rotation R and the position p, whose non-constant
+ * entries are stored in fresh variables at each link.
+ */
+class Emitter
+{
+    const Kinematics &kin;
+    ostream &out;
+    Expr R[3][3];
+    Expr p[3];
+    vector<Expr> z,o;
+
+    /**********************************************************/
+    Expr store(const Expr &e, const string &name)
+    {
+        if (e.isConst)
+            return e;
+
+        out<<"    const double "<<name<<"="<<e.code<<";"<<endl;
+        return Expr(name);
+    }
+
+    /**********************************************************/
+    void storeFrame(const string &suffix)
+    {
+        for (int r=0; r<3; r++)
+        {
+            for (int c=0; c<3; c++)
+            {
+                ostringstream name;
+                name<<"R"<<r<<c<<"_"<<suffix;
+                R[r][c]=store(R[r][c],name.str());
+            }
+        }
+
+        for (int r=0; r<3; r++)
+        {
+            ostringstream name;
+            name<<"p"<<r<<"_"<<suffix;
+            p[r]=store(p[r],name.str());
+        }
+    }
+
+    /**
+     * Right-multiply the frame by a constant homogeneous matrix.
+     */
+    void transform(const double *H)
+    {
+        Expr Rn[3][3],pn[3];
+        for (int r=0; r<3; r++)
+        {
+            pn[r]=p[r];
+            for (int k=0; k<3; k++)
+                pn[r]=add(pn[r],mul(R[r][k],Expr(snap(H[4*k+3]))));
+
+            for (int c=0; c<3; c++)
+            {
+                Rn[r][c]=Expr(0.0);
+                for (int k=0; k<3; k++)
+                    Rn[r][c]=add(Rn[r][c],mul(R[r][k],Expr(snap(H[4*k+c]))));
+            }
+        }
+
+        for (int r=0; r<3; r++)
+        {
+            p[r]=pn[r];
+            for (int c=0; c<3; c++)
+                R[r][c]=Rn[r][c];
+        }
+    }
+
+    /**
+     * Right-multiply the frame by the DH matrix of the link i:
+     * Rz(theta)*Tz(D)*Tx(A)*Rx(alpha).
+     */
+    void link(const size_t i)
+    {
+        ostringstream c,s;
+        c<<"c"<<i;
+        s<<"s"<<i;
+
+        string theta="q["+to_string(i)+"]";
+        if (snap(kin.offset[i])!=0.0)
+            theta+="+"+text(Expr(kin.offset[i]));
+
+        out<<"    const double "<<c.str()<<"=cos("<<theta<<");"<<endl;
+        out<<"    const double "<<s.str()<<"=sin("<<theta<<");"<<endl;
+
+        Expr ci(c.str()),si(s.str());
+        Expr a(snap(kin.A[i])),d(snap(kin.D[i]));
+        Expr ca(snap(cos(kin.alpha[i]))),sa(snap(sin(kin.alpha[i])));
+
+        // the joint axis and origin ahead of the rotation
+        z.push_back(R[0][2]); z.push_back(R[1][2]); z.push_back(R[2][2]);
+        o.push_back(p[0]);    o.push_back(p[1]);    o.push_back(p[2]);
+
+        for (int r=0; r<3; r++)
+        {
+            Expr t=add(mul(R[r][0],mul(a,ci)),mul(R[r][1],mul(a,si)));
+            p[r]=add(p[r],add(t,mul(R[r][2],d)));
+
+            Expr x=R[r][0],y=R[r][1];
+            Expr col0=add(mul(x,ci),mul(y,si));
+            Expr col1=sub(mul(y,ci),mul(x,si));
+
+            R[r][0]=col0;
+            R[r][1]=add(mul(col1,ca),mul(R[r][2],sa));
+            R[r][2]=sub(mul(R[r][2],ca),mul(col1,sa));
+        }
+
+        storeFrame(to_string(i));
+    }
+
+public:
+    /**********************************************************/
+    Emitter(const Kinematics &kin, ostream &out) : kin(kin), out(out) { }
+
+    /**********************************************************/
+    void emit(const bool jacobian)
+    {
+        z.clear();
+        o.clear();
+
+        for (int r=0; r<3; r++)
+        {
+            p[r]=Expr(snap(kin.H0[4*r+3]));
+            for (int c=0; c<3; c++)
+                R[r][c]=Expr(snap(kin.H0[4*r+c]));
+        }
+
+        for (size_t i=0; i<kin.A.size(); i++)
+            link(i);
+
+        transform(kin.HN);
+        storeFrame("e");
+
+        for (int r=0; r<3; r++)
+        {
+            for (int c=0; c<3; c++)
+                out<<"    H["<<4*r+c<<"]="<<text(R[r][c])<<";"<<endl;
+            out<<"    H["<<4*r+3<<"]="<<text(p[r])<<";"<<endl;
+        }
+        out<<"    H[12]=0.0; H[13]=0.0; H[14]=0.0; H[15]=1.0;"<<endl;
+
+        if (!jacobian)
+            return;
+
+        // revolute joints: [z x (pe-o); z]
+        size_t n=kin.A.size();
+        for (size_t i=0; i<n; i++)
+        {
+            Expr dx=sub(p[0],o[3*i+0]);
+            Expr dy=sub(p[1],o[3*i+1]);
+            Expr dz=sub(p[2],o[3*i+2]);
+            const Expr *zi=&z[3*i];
+
+            Expr col[6];
+            col[0]=sub(mul(zi[1],dz),mul(zi[2],dy));
+            col[1]=sub(mul(zi[2],dx),mul(zi[0],dz));
+            col[2]=sub(mul(zi[0],dy),mul(zi[1],dx));
+            col[3]=zi[0];
+            col[4]=zi[1];
+            col[5]=zi[2];
+
+            for (int r=0; r<6; r++)
+                out<<"    J["<<r*n+i<<"]="<<text(col[r])<<";"<<endl;
+        }
+    }
+};
+
+/**********************************************************/
+void array(ostream &out, const string &name, const vector<double> &v)
+{
+    out<<"constexpr double "<<name<<"[N]={";
+    for (size_t i=0; i<v.size(); i++)
+        out<<(i>0?", ":"")<<literal(v[i]);
+    out<<"};"<<endl;
+}
+
+/**********************************************************/
+void matrix(ostream &out, const string &name, const double *H)
+{
+    out<<"constexpr double "<<name<<"[16]={";
+    for (int i=0; i<16; i++)
+        out<<(i>0?", ":"")<<literal(H[i]);
+    out<<"};"<<endl;
+}
+
+/**********************************************************/
+void generate(ostream &out, const Kinematics &kin, const string &name,
+              const string &source)
+{
+    string guard=name;
+    transform(guard.begin(),guard.end(),guard.begin(),::toupper);
+    guard="__"+guard+"_H__";
+
+    out<<"// This file has been generated by kinCompiler from \""<<source<<"\": do not edit."<<endl;
+    out<<endl;
+    out<<"#ifndef "<<guard<<endl;
+    out<<"#define "<<guard<<endl;
+    out<<endl;
+    out<<"#include <math.h>"<<endl;
+    out<<endl;
+    out<<"namespace "<<name<<endl;
+    out<<"{"<<endl;
+    out<<endl;
+    out<<"// the DH parameters and the joints bounds, angles in [rad]"<<endl;
+    out<<"constexpr unsigned int N="<<kin.A.size()<<";"<<endl;
+    array(out,"A",kin.A);
+    array(out,"D",kin.D);
+    array(out,"alpha",kin.alpha);
+    array(out,"offset",kin.offset);
+    array(out,"qmin",kin.min);
+    array(out,"qmax",kin.max);
+    matrix(out,"H0",kin.H0);
+    matrix(out,"HN",kin.HN);
+    out<<endl;
+
+    Emitter emitter(kin,out);
+
+    out<<"/**"<<endl;
+    out<<" * The pose of the end-effector."<<endl;
+    out<<" * @param q the N joints angles in [rad]."<<endl;
+    out<<" * @param H the 4x4 homogeneous matrix in row-major order."<<endl;
+    out<<" */"<<endl;
+    out<<"inline void forward(const double *q, double *H)"<<endl;
+    out<<"{"<<endl;
+    emitter.emit(false);
+    out<<"}"<<endl;
+    out<<endl;
+    out<<"/**"<<endl;
+    out<<" * The geometric Jacobian along with the pose of the end-effector."<<endl;
+    out<<" * @param q the N joints angles in [rad]."<<endl;
+    out<<" * @param J the 6xN Jacobian in row-major order."<<endl;
+    out<<" * @param H the 4x4 homogeneous matrix in row-major order."<<endl;
+    out<<" */"<<endl;
+    out<<"inline void jacobian(const double *q, double *J, double *H)"<<endl;
+    out<<"{"<<endl;
+    emitter.emit(true);
+    out<<"}"<<endl;
+    out<<endl;
+    out<<"}"<<endl;
+    out<<endl;
+    out<<"#endif"<<endl;
+    out<<endl;
+}
+
+/**
+ * Retrieve the kinematics in the same format given to iKinLimb.
+ */
+bool parse(Property &options, Kinematics &kin)
+{
+    const double deg2rad=M_PI/180.0;
+
+    int numLinks=options.check("numLinks",Value(0)).asInt();
+    if (numLinks<=0)
+    {
+        cout<<"Error: invalid \"numLinks\""<<endl;
+        return false;
+    }
+
+    const char *frames[]={"H0","HN"};
+    double *H[]={kin.H0,kin.HN};
+    for (int k=0; k<2; k++)
+    {
+        for (int i=0; i<16; i++)
+            H[k][i]=((i%5)==0)?1.0:0.0;
+
+        if (Bottle *list=options.find(frames[k]).asList())
+        {
+            if (list->size()!=16)
+            {
+                cout<<"Error: \""<<frames[k]<<"\" shall contain 16 values"<<endl;
+                return false;
+            }
+
+            for (int i=0; i<16; i++)
+                H[k][i]=list->get(i).asDouble();
+        }
+    }
+
+    for (int i=0; i<numLinks; i++)
+    {
+        ostringstream entry;
+        entry<<"link_"<<i;
+
+        Bottle &link=options.findGroup(entry.str().c_str());
+        if (link.isNull())
+        {
+            cout<<"Error: \""<<entry.str()<<"\" is missing"<<endl;
+            return false;
+        }
+
+        kin.A.push_back(link.check("A",Value(0.0)).asDouble());
+        kin.D.push_back(link.check("D",Value(0.0)).asDouble());
+        kin.alpha.push_back(deg2rad*link.check("alpha",Value(0.0)).asDouble());
+        kin.offset.push_back(deg2rad*link.check("offset",Value(0.0)).asDouble());
+        kin.min.push_back(deg2rad*link.check("min",Value(-180.0)).asDouble());
+        kin.max.push_back(deg2rad*link.check("max",Value(180.0)).asDouble());
+    }
+
+    return true;
+}
+
+/**********************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help") || !rf.check("kinematics_file") || !rf.check("header"))
+    {
+        cout<<"Options:"<<endl;
+        cout<<"\t--kinematics_file <file>   the kinematics description (as for iKinLimb)"<<endl;
+        cout<<"\t--header          <file>   the header to generate"<<endl;
+        cout<<"\t--name            <string> the namespace of the generated code (default: compiledKinematics)"<<endl;
+        return rf.check("help")?0:1;
+    }
+
+    string from=rf.find("kinematics_file").asString().c_str();
+    string file=rf.find("header").asString().c_str();
+    string name=rf.check("name",Value("compiledKinematics")).asString().c_str();
+
+    Property options;
+    if (!options.fromConfigFile(from.c_str()))
+    {
+        cout<<"Error: unable to read \""<<from<<"\""<<endl;
+        return 1;
+    }
+
+    Kinematics kin;
+    if (!parse(options,kin))
+        return 1;
+
+    ofstream out(file.c_str());
+    if (!out.is_open())
+    {
+        cout<<"Error: unable to create \""<<file<<"\""<<endl;
+        return 1;
+    }
+
+    string source=from.substr(from.find_last_of("/\\")+1);
+    generate(out,kin,name,source);
+
+    return 0;
+}
+
+
@@ -0,0 +1,222 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <iostream>
+
+#include "serverModule.h"
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+using namespace yarp::sig;
+using namespace serverModule;
+
+
+/**********************************************************/
+void TargetPort::onRead(Vector &xd)
+{
+    if (icart==NULL)
+        return;
+
+    Stamp info;
+    getEnvelope(info);
+    int id=info.getCount();
+
+    bool ok=false;
+    if (xd.length()>=7)
+        ok=icart->goToPose(xd.subVector(0,2),xd.subVector(3,6));
+    else if (xd.length()>=3)
+        ok=icart->goToPosition(xd.subVector(0,2));
+
+    mutex.wait();
+
+    // a smaller id means that the client has been restarted
+    if ((lastReceived>=0) && (id>lastReceived))
+        superseded+=id-lastReceived-1;
+    lastReceived=id;
+
+    if (ok)
+        seq=id;
+    else
+        rejected++;
+
+    mutex.post();
+}
+
+/**********************************************************/
+void TargetPort::getStatus(int &seq, unsigned int &superseded, unsigned int &rejected)
+{
+    mutex.wait();
+    seq=this->seq;
+    superseded=this->superseded;
+    rejected=this->rejected;
+    mutex.post();
+}
+
+/**********************************************************/
+void StatePublisher::threadRelease()
+{
+    port.interrupt();
+    port.close();
+}
+
+/**********************************************************/
+void StatePublisher::run()
+{
+    if (port.getOutputCount()==0)
+        return;
+
+    if (!icart->getPose(x,o) || !icart->getTaskVelocities(xdot,odot))
+        return;
+
+    int seq;
+    unsigned int superseded,rejected;
+    targets.getStatus(seq,superseded,rejected);
+
+    Vector &state=port.prepare();
+    state.resize(12);
+    for (size_t i=0; i<3; i++)
+    {
+        state[i]=x[i];
+        state[7+i]=xdot[i];
+    }
+    for (size_t i=0; i<4; i++)
+        state[3+i]=o[i];
+    state[10]=superseded;
+    state[11]=rejected;
+
+    Stamp stamp(seq,Time::now());
+    port.setEnvelope(stamp);
+    port.write();
+}
+
+/**********************************************************/
+bool ServerModule::configure(ResourceFinder &rf)
+{   
+    // grab parameters from the configuration file
+    string robot=rf.find("robot").asString().c_str();
+    string part=rf.find("part").asString().c_str();
+    string local=rf.find("local").asString().c_str();
+    string pathToKin=rf.findFile("kinematics_file").c_str();
+
+    // prepare the option to open up the device driver to
+    // access the fake robot
+    Property optPart;
+    optPart.put("device","fakeyClient");
+    optPart.put("remote",("/"+robot+"/"+part).c_str());
+    optPart.put("local",("/"+local+"/"+part).c_str());
+    optPart.put("part",part.c_str());
+    if (rf.check("state_timeout"))
+        optPart.put("state_timeout",rf.find("state_timeout").asDouble());
+    if (rf.check("lockstep"))
+        optPart.put("lockstep",rf.find("lockstep").asString().c_str());
+    if (rf.check("state_sync"))
+    {
+        optPart.put("state_sync",rf.find("state_sync").asString().c_str());
+        optPart.put("state_sync_watchdog",rf.check("state_sync_watchdog",Value(0.02)).asDouble());
+        optPart.put("state_sync_threshold",rf.check("state_sync_threshold",Value(0.0)).asDouble());
+    }
+    if (rf.check("wire"))
+        optPart.put("wire",rf.find("wire").asString().c_str());
+    if (rf.check("carrier"))
+        optPart.put("carrier",rf.find("carrier").asString().c_str());
+
+    // many servers can drive disjoint subsets of the joints of
+    // the same part through sessions of their own
+    if (rf.check("session"))
+    {
+        optPart.put("session",rf.find("session").asString().c_str());
+        optPart.put("priority",rf.check("priority",Value(1)).asInt());
+        if (rf.check("joints"))
+            optPart.put("joints",rf.find("joints"));
+    }
+
+    // open the device driver
+    if (!partDrv.open(optPart))
+    {
+        cout<<"Error: Device driver not available!"<<endl;
+        close();
+        return false;
+    }
+
+    // now go on with the server driver
+    PolyDriverList list;
+    list.push(&partDrv,part.c_str());
+
+    // take the parameters and fill the kinematic description
+    Property optServer("(device cartesiancontrollerserver)");
+    optServer.fromConfigFile(rf.findFile("from").c_str(),false);
+    if (!server.open(optServer))
+    {
+        cout<<"Error: Unable to open the Cartesian Controller Server!"<<endl;
+        close();    
+        return false;
+    }
+
+    // attach the device driver to the server
+    IMultipleWrapper *wrapper;
+    server.view(wrapper);
+    if (!wrapper->attachAll(list))
+    {
+        cout<<"Error: Unable to attach device drivers!"<<endl;
+        close();    
+        return false;
+    }
+
+    // the targets can also be streamed through <local>/target:i,
+    // whereas the state echoing their ids goes through
+    // <local>/stream:o at the controller rate
+    ICartesianControl *icart;
+    if (server.view(icart))
+    {
+        int period=rf.findGroup("GENERAL").check("ControllerPeriod",Value(20)).asInt();
+
+        targetPort.setController(icart);
+        targetPort.open(("/"+local+"/target:i").c_str());
+
+        publisher=new StatePublisher(icart,targetPort,period);
+        publisher->open("/"+local+"/stream:o");
+        publisher->start();
+    }
+
+    return true;
+}
+
+/**********************************************************/
+bool ServerModule::close()
+{
+    if (publisher!=NULL)
+    {
+        publisher->stop();
+        delete publisher;
+        publisher=NULL;
+    }
+
+    targetPort.interrupt();
+    targetPort.close();
+    targetPort.setController(NULL);
+
+    if (server.isValid())
+        server.close();
+
+    if (partDrv.isValid())
+        partDrv.close();
+
+    return true;
+}
+
+
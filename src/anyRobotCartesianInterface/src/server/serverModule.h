@@ -0,0 +1,124 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __SERVERMODULE_H__
+#define __SERVERMODULE_H__
+
+#include <string>
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+#include <yarp/sig/all.h>
+
+namespace serverModule
+{
+
+/**
+ * This class receives the streamed targets, each carrying its
+ * sequence id in the envelope, and hands them over to the
+ * controller without waiting: since the port keeps only the latest
+ * target pending, the targets arriving faster than the controller
+ * can take them are superseded (latest-wins). A target is either
+ * a position (3 values) or a pose (7 values: position followed by
+ * the axis-angle orientation).
+ *
+ * The targets superseded (i.e. the gaps in the received ids) and
+ * those rejected by the controller are counted apart.
+ */
+class TargetPort : public yarp::os::BufferedPort<yarp::sig::Vector>
+{
+    yarp::dev::ICartesianControl *icart;
+    yarp::os::Semaphore mutex;
+    int seq,lastReceived;
+    unsigned int superseded,rejected;
+
+    void onRead(yarp::sig::Vector &xd);
+
+public:
+    /**********************************************************/
+    TargetPort() : icart(NULL), seq(-1), lastReceived(-1), superseded(0),
+                   rejected(0) { useCallback(); }
+
+    /**********************************************************/
+    void setController(yarp::dev::ICartesianControl *icart) { this->icart=icart; }
+
+    /**
+     * Retrieve the id of the latest target handed over to the
+     * controller (-1 if none) along with the number of targets
+     * superseded and rejected so far.
+     */
+    void getStatus(int &seq, unsigned int &superseded, unsigned int &rejected);
+};
+
+/**
+ * This class streams the state of the end-effector, i.e. the pose
+ * followed by the translational velocity, echoing the id of the
+ * latest target taken by the controller as the count of the
+ * envelope: the clients can thus measure the latency from the
+ * target to the motion. The state ends with the number of targets
+ * superseded and rejected so far.
+ */
+class StatePublisher : public yarp::os::RateThread
+{
+    yarp::dev::ICartesianControl             *icart;
+    TargetPort                               &targets;
+    yarp::os::BufferedPort<yarp::sig::Vector> port;
+    yarp::sig::Vector x,o,xdot,odot;
+
+public:
+    /**********************************************************/
+    StatePublisher(yarp::dev::ICartesianControl *icart, TargetPort &targets,
+                   const int period) : RateThread(period), icart(icart),
+                   targets(targets) { }
+
+    /**********************************************************/
+    bool open(const std::string &name) { return port.open(name.c_str()); }
+
+    void threadRelease();
+
+    void run();
+};
+
+/**
+ * This class launches the server.
+ */
+class ServerModule: public yarp::os::RFModule
+{
+protected:
+    yarp::dev::PolyDriver partDrv;
+    yarp::dev::PolyDriver server;
+
+    TargetPort      targetPort;
+    StatePublisher *publisher;
+
+public:
+    /**********************************************************/
+    ServerModule() : publisher(NULL) { }
+
+    bool configure(yarp::os::ResourceFinder &rf);
+
+    bool close();
+
+    /**********************************************************/
+    double getPeriod()    { return 1.0;  }
+    bool   updateModule() { return true; }
+};
+
+}
+
+#endif
+
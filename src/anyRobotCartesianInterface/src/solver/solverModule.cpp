@@ -0,0 +1,1324 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <algorithm>
+#include <math.h>
+
+#include "solverModule.h"
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace iCub::iKin;
+using namespace solverModule;
+
+
+/**********************************************************/
+Vector SolutionCache::rotation(const Vector &xd)
+{
+    Vector r(3,0.0);
+    if (xd.length()>=7)
+        for (size_t i=0; i<3; i++)
+            r[i]=xd[6]*xd[3+i];
+
+    return r;
+}
+
+/**********************************************************/
+vector<long> SolutionCache::quantize(const Vector &xd, const bool orientation) const
+{
+    vector<long> key;
+    for (size_t i=0; (i<3) && (i<xd.length()); i++)
+        key.push_back((long)floor(xd[i]/posTol+0.5));
+
+    if (orientation)
+    {
+        Vector r=rotation(xd);
+        for (size_t i=0; i<r.length(); i++)
+            key.push_back((long)floor(r[i]/angTol+0.5));
+    }
+
+    return key;
+}
+
+/**********************************************************/
+double SolutionCache::distance(const Vector &a, const Vector &b, const size_t i0,
+                               const size_t len)
+{
+    double d=0.0;
+    for (size_t i=i0; i<i0+len; i++)
+        d+=(a[i]-b[i])*(a[i]-b[i]);
+
+    return sqrt(d);
+}
+
+/**********************************************************/
+SolutionCache::SolutionCache() : enabled(false), capacity(256), posTol(1e-4), angTol(1e-3),
+                                 warmPos(0.05), warmAng(0.2), clock(0)
+{
+    reset();
+}
+
+/**********************************************************/
+void SolutionCache::configure(Searchable &options)
+{
+    enabled=(options.check("cache",Value("on")).asString()=="on");
+    capacity=(size_t)options.check("cache_size",Value(256)).asInt();
+    posTol=options.check("cache_pos_tol",Value(1e-4)).asDouble();
+    angTol=options.check("cache_ang_tol",Value(1e-3)).asDouble();
+    warmPos=options.check("warm_pos",Value(0.05)).asDouble();
+    warmAng=options.check("warm_ang",Value(0.2)).asDouble();
+
+    if ((capacity==0) || (posTol<=0.0) || (angTol<=0.0))
+        enabled=false;
+}
+
+/**********************************************************/
+bool SolutionCache::lookup(const string &sig, const Vector &xd, const bool orientation,
+                           Vector &q, bool &hit)
+{
+    if (!enabled)
+        return false;
+
+    mutex.wait();
+
+    if (sig!=signature)
+    {
+        entries.clear();
+        signature=sig;
+    }
+
+    lookups++;
+    clock++;
+
+    map<vector<long>,Entry>::iterator it=entries.find(quantize(xd,orientation));
+    if (it!=entries.end())
+    {
+        it->second.lastUse=clock;
+        q=it->second.q;
+        hit=true;
+        hits++;
+        mutex.post();
+        return true;
+    }
+
+    // the closest target within the warm-start region
+    Entry *closest=NULL;
+    double dmin=0.0;
+    Vector r=rotation(xd);
+    for (it=entries.begin(); it!=entries.end(); it++)
+    {
+        Entry &e=it->second;
+        if (e.xd.length()!=xd.length())
+            continue;
+
+        double dp=distance(xd,e.xd,0,3);
+        double da=orientation?distance(r,rotation(e.xd),0,3):0.0;
+        if ((dp<=warmPos) && (da<=warmAng))
+        {
+            double d=dp/warmPos+((warmAng>0.0)?da/warmAng:0.0);
+            if ((closest==NULL) || (d<dmin))
+            {
+                closest=&e;
+                dmin=d;
+            }
+        }
+    }
+
+    if (closest!=NULL)
+    {
+        closest->lastUse=clock;
+        q=closest->q;
+        hit=false;
+        warmStarts++;
+    }
+
+    mutex.post();
+    return (closest!=NULL);
+}
+
+/**********************************************************/
+void SolutionCache::store(const Vector &xd, const bool orientation, const Vector &q)
+{
+    if (!enabled)
+        return;
+
+    mutex.wait();
+
+    if (entries.size()>=capacity)
+    {
+        map<vector<long>,Entry>::iterator lru=entries.begin();
+        for (map<vector<long>,Entry>::iterator it=entries.begin(); it!=entries.end(); it++)
+            if (it->second.lastUse<lru->second.lastUse)
+                lru=it;
+
+        entries.erase(lru);
+        evictions++;
+    }
+
+    Entry &e=entries[quantize(xd,orientation)];
+    e.xd=xd;
+    e.q=q;
+    e.lastUse=++clock;
+
+    mutex.post();
+}
+
+/**********************************************************/
+void SolutionCache::clear()
+{
+    mutex.wait();
+    entries.clear();
+    mutex.post();
+}
+
+/**********************************************************/
+void SolutionCache::reset()
+{
+    lookups=hits=warmStarts=evictions=0;
+}
+
+/**********************************************************/
+void SolutionCache::toBottle(Bottle &b)
+{
+    mutex.wait();
+    Bottle &l=b.addList(); l.addString("lookups");   l.addInt((int)lookups);
+    Bottle &h=b.addList(); h.addString("hits");      h.addInt((int)hits);
+    Bottle &w=b.addList(); w.addString("warm");      w.addInt((int)warmStarts);
+    Bottle &m=b.addList(); m.addString("misses");    m.addInt((int)(lookups-hits-warmStarts));
+    Bottle &e=b.addList(); e.addString("evictions"); e.addInt((int)evictions);
+    Bottle &s=b.addList(); s.addString("size");      s.addInt((int)entries.size());
+    Bottle &r=b.addList(); r.addString("hit_rate");  r.addDouble(lookups>0?(double)hits/lookups:0.0);
+    mutex.post();
+}
+
+/**********************************************************/
+void PlanarChain::advance(State &st, const size_t i, const double th) const
+{
+    st.h+=st.s*th;
+    st.z+=st.s*D[i];
+    st.x+=A[i]*cos(st.h);
+    st.y+=A[i]*sin(st.h);
+    if (flip[i])
+        st.s=-st.s;
+}
+
+/**********************************************************/
+void PlanarChain::tool(State &st) const
+{
+    double c=cos(st.h);
+    double s=sin(st.h);
+    st.x+=toolX*c-st.s*toolY*s;
+    st.y+=toolX*s+st.s*toolY*c;
+    st.z+=st.s*toolZ;
+    st.h+=st.s*toolH;
+    st.s*=toolS;
+}
+
+/**********************************************************/
+PlanarChain::State PlanarChain::forward() const
+{
+    State st;
+    for (size_t i=0; i<N; i++)
+        advance(st,i,theta[i]);
+    tool(st);
+
+    return st;
+}
+
+/**********************************************************/
+double PlanarChain::wrap(const double a)
+{
+    return a-2.0*M_PI*floor(a/(2.0*M_PI)+0.5);
+}
+
+/**********************************************************/
+bool PlanarChain::fit(double &th, const double lo, const double hi, const double ref)
+{
+    th=ref+wrap(th-ref);
+    if (th>hi)
+        th-=2.0*M_PI;
+    else if (th<lo)
+        th+=2.0*M_PI;
+
+    return ((th>=lo) && (th<=hi));
+}
+
+/**********************************************************/
+bool PlanarChain::analytic(const double x, const double y, const double h, const bool orientation)
+{
+    size_t j1=active[0];
+    size_t j2=active[1];
+    size_t k=orientation?active[2]:N;
+
+    // the frame preceding the first joint and the rigid segments
+    // spanning from each joint to the next one
+    State base;
+    for (size_t i=0; i<j1; i++)
+        advance(base,i,theta[i]);
+
+    State seg1(base.s);
+    advance(seg1,j1,0.0);
+    for (size_t i=j1+1; i<j2; i++)
+        advance(seg1,i,theta[i]);
+
+    State seg2(seg1.s);
+    advance(seg2,j2,0.0);
+    for (size_t i=j2+1; i<k; i++)
+        advance(seg2,i,theta[i]);
+
+    // the heading fixes the last segment, leaving the wrist
+    double wx=x-base.x;
+    double wy=y-base.y;
+    double hk=0.0;
+    if (orientation)
+    {
+        State tail(seg2.s);
+        advance(tail,k,0.0);
+        for (size_t i=k+1; i<N; i++)
+            advance(tail,i,theta[i]);
+        tool(tail);
+
+        hk=h-tail.h;
+        wx-=tail.x*cos(hk)-tail.y*sin(hk);
+        wy-=tail.x*sin(hk)+tail.y*cos(hk);
+    }
+    else
+        tool(seg2);
+
+    double L1=sqrt(seg1.x*seg1.x+seg1.y*seg1.y);
+    double L2=sqrt(seg2.x*seg2.x+seg2.y*seg2.y);
+    if ((L1<1e-9) || (L2<1e-9))
+        return false;
+
+    double c=(wx*wx+wy*wy-L1*L1-L2*L2)/(2.0*L1*L2);
+    if (fabs(c)>1.0+1e-9)
+        return false;
+    c=(c>1.0)?1.0:((c<-1.0)?-1.0:c);
+
+    double g1=atan2(seg1.y,seg1.x);
+    double g2=atan2(seg2.y,seg2.x);
+    double gw=atan2(wy,wx);
+
+    double best[3];
+    double costMin=-1.0;
+    for (int elbow=-1; elbow<=1; elbow+=2)
+    {
+        double b=elbow*acos(c);
+        double a1=gw-atan2(L2*sin(b),L1+L2*cos(b));
+        double h1=a1-g1;
+        double h2=a1+b-g2;
+
+        double sol[3];
+        sol[0]=base.s*(h1-base.h);
+        sol[1]=seg1.s*(h2-h1-seg1.h);
+        sol[2]=seg2.s*(hk-h2-seg2.h);
+
+        bool ok=true;
+        double cost=0.0;
+        for (size_t i=0; i<active.size(); i++)
+        {
+            size_t j=active[i];
+            ok&=fit(sol[i],lo[j],hi[j],theta[j]);
+            cost+=(sol[i]-theta[j])*(sol[i]-theta[j]);
+        }
+
+        if (ok && ((costMin<0.0) || (cost<costMin)))
+        {
+            for (size_t i=0; i<active.size(); i++)
+                best[i]=sol[i];
+            costMin=cost;
+        }
+    }
+
+    if (costMin<0.0)
+        return false;
+
+    for (size_t i=0; i<active.size(); i++)
+        theta[active[i]]=best[i];
+
+    return true;
+}
+
+/**********************************************************/
+bool PlanarChain::dls(const double x, const double y, const double h, const bool orientation)
+{
+    size_t m=orientation?3:2;
+    size_t n=active.size();
+
+    for (int iter=0; iter<=maxIter; iter++)
+    {
+        State st;
+        for (size_t i=0; i<N; i++)
+        {
+            ox[i]=st.x; oy[i]=st.y; os[i]=st.s;
+            advance(st,i,theta[i]);
+        }
+        tool(st);
+
+        double e[3]={x-st.x, y-st.y, orientation?wrap(h-st.h):0.0};
+        if (sqrt(e[0]*e[0]+e[1]*e[1]+e[2]*e[2])<tol)
+            return true;
+        else if (iter==maxIter)
+            break;
+
+        // M=J*J'+lambda^2*I
+        double M[3][3]={{0.0}};
+        for (size_t k=0; k<n; k++)
+        {
+            size_t j=active[k];
+            double *J=&jac[3*k];
+            J[0]=-os[j]*(st.y-oy[j]);
+            J[1]=os[j]*(st.x-ox[j]);
+            J[2]=os[j];
+
+            for (size_t r=0; r<m; r++)
+                for (size_t c=0; c<m; c++)
+                    M[r][c]+=J[r]*J[c];
+        }
+
+        for (size_t r=0; r<m; r++)
+            M[r][r]+=lambda*lambda;
+
+        // M is symmetric positive definite: plain elimination
+        for (size_t p=0; p<m; p++)
+        {
+            for (size_t r=p+1; r<m; r++)
+            {
+                double f=M[r][p]/M[p][p];
+                for (size_t c=p; c<m; c++)
+                    M[r][c]-=f*M[p][c];
+                e[r]-=f*e[p];
+            }
+        }
+
+        for (size_t p=m; p-->0;)
+        {
+            for (size_t c=p+1; c<m; c++)
+                e[p]-=M[p][c]*e[c];
+            e[p]/=M[p][p];
+        }
+
+        // dtheta=J'*inv(M)*e
+        for (size_t k=0; k<n; k++)
+        {
+            size_t j=active[k];
+            double *J=&jac[3*k];
+            double dth=0.0;
+            for (size_t r=0; r<m; r++)
+                dth+=J[r]*e[r];
+
+            double th=theta[j]+dth;
+            theta[j]=(th<lo[j])?lo[j]:((th>hi[j])?hi[j]:th);
+        }
+    }
+
+    return false;
+}
+
+/**********************************************************/
+void PlanarChain::setParameters(const double lambda, const double tol, const int maxIter)
+{
+    this->lambda=lambda;
+    this->tol=tol;
+    this->maxIter=maxIter;
+}
+
+/**********************************************************/
+bool PlanarChain::configure(iKinChain &chain)
+{
+    valid=false;
+    N=chain.getN();
+    A.resize(N); D.resize(N); offset.resize(N); flip.resize(N);
+    theta.resize(N); lo.resize(N); hi.resize(N);
+    ox.resize(N); oy.resize(N); os.resize(N);
+    jac.resize(3*N);
+    active.reserve(N);
+
+    for (size_t i=0; i<N; i++)
+    {
+        iKinLink &link=chain[(unsigned int)i];
+        if (fabs(sin(link.getAlpha()))>1e-9)
+            return false;
+
+        A[i]=link.getA();
+        D[i]=link.getD();
+        offset[i]=link.getOffset();
+        flip[i]=(cos(link.getAlpha())<0.0);
+    }
+
+    Matrix HN=chain.getHN();
+    if (fabs(HN(2,2))<1.0-1e-9)
+        return false;
+
+    toolX=HN(0,3);
+    toolY=HN(1,3);
+    toolZ=HN(2,3);
+    toolH=atan2(HN(1,0),HN(0,0));
+    toolS=(HN(2,2)>0.0)?1.0:-1.0;
+    H0=chain.getH0();
+
+    for (size_t i=0; i<N; i++)
+        theta[i]=offset[i];
+
+    State st=forward();
+    height=st.z;
+    sign=st.s;
+
+    // compare the model with the chain at a few configurations
+    Vector q0=chain.getAng();
+    Vector q(chain.getDOF());
+    bool ok=true;
+    for (int k=0; (k<5) && ok; k++)
+    {
+        for (size_t i=0, j=0; i<N; i++)
+        {
+            iKinLink &link=chain[(unsigned int)i];
+            double ang=link.getAng();
+            if (!link.isBlocked())
+            {
+                ang=link.getMin()+(link.getMax()-link.getMin())*(0.5+0.45*sin(1.7*k+i));
+                q[j++]=ang;
+            }
+            theta[i]=ang+offset[i];
+        }
+
+        Matrix H=chain.getH(q);
+        st=forward();
+        for (int r=0; r<3; r++)
+        {
+            double p=H0(r,3)+H0(r,0)*st.x+H0(r,1)*st.y+H0(r,2)*st.z;
+            double xr=H0(r,0)*cos(st.h)+H0(r,1)*sin(st.h);
+            double zr=H0(r,2)*st.s;
+            ok&=(fabs(H(r,3)-p)<1e-6) && (fabs(H(r,0)-xr)<1e-6) && (fabs(H(r,2)-zr)<1e-6);
+        }
+    }
+    chain.setAng(q0);
+
+    valid=ok;
+    return valid;
+}
+
+/**********************************************************/
+int PlanarChain::solve(iKinChain &chain, const Vector &xd, const bool orientation, Vector &q)
+{
+    if (!valid || (xd.length()<(orientation?7:3)))
+        return NONE;
+
+    // the target in the base frame
+    double p[3];
+    for (int r=0; r<3; r++)
+        p[r]=H0(0,r)*(xd[0]-H0(0,3))+H0(1,r)*(xd[1]-H0(1,3))+H0(2,r)*(xd[2]-H0(2,3));
+
+    if (fabs(p[2]-height)>tol)
+        return NONE;
+
+    double h=0.0;
+    if (orientation)
+    {
+        // the first and the third columns of the rotation
+        double kx=xd[3], ky=xd[4], kz=xd[5];
+        double c=cos(xd[6]), s=sin(xd[6]), v=1.0-c;
+        double rx[3]={c+kx*kx*v, ky*kx*v+kz*s, kz*kx*v-ky*s};
+        double rz[3]={kx*kz*v+ky*s, ky*kz*v-kx*s, c+kz*kz*v};
+
+        double x[3],z[3];
+        for (int r=0; r<3; r++)
+        {
+            x[r]=H0(0,r)*rx[0]+H0(1,r)*rx[1]+H0(2,r)*rx[2];
+            z[r]=H0(0,r)*rz[0]+H0(1,r)*rz[1]+H0(2,r)*rz[2];
+        }
+
+        if (sign*z[2]<1.0-1e-9)
+            return NONE;
+
+        h=atan2(x[1],x[0]);
+    }
+
+    active.clear();
+    for (size_t i=0; i<N; i++)
+    {
+        iKinLink &link=chain[(unsigned int)i];
+        theta[i]=link.getAng()+offset[i];
+        lo[i]=link.getMin()+offset[i];
+        hi[i]=link.getMax()+offset[i];
+        if (!link.isBlocked())
+            active.push_back(i);
+    }
+
+    size_t m=orientation?3:2;
+    int method=NONE;
+    if (active.size()==m)
+        method=analytic(p[0],p[1],h,orientation)?ANALYTIC:NONE;
+    else if (active.size()>m)
+        method=dls(p[0],p[1],h,orientation)?DLS:NONE;
+
+    if (method!=NONE)
+    {
+        q.resize(active.size());
+        for (size_t i=0; i<active.size(); i++)
+            q[i]=theta[active[i]]-offset[active[i]];
+    }
+
+    return method;
+}
+
+#ifdef USE_COMPILED_KINEMATICS
+
+/**********************************************************/
+bool CompiledChain::match(const double a, const double b)
+{
+    return (fabs(a-b)<1e-9);
+}
+
+/**********************************************************/
+CompiledChain::CompiledChain() : valid(false), lambda(0.01), tol(1e-6), maxIter(100)
+{
+    active.reserve(compiledKinematics::N);
+}
+
+/**********************************************************/
+void CompiledChain::setParameters(const double lambda, const double tol, const int maxIter)
+{
+    this->lambda=lambda;
+    this->tol=tol;
+    this->maxIter=maxIter;
+}
+
+/**********************************************************/
+bool CompiledChain::configure(iKinChain &chain)
+{
+    using namespace compiledKinematics;
+
+    valid=false;
+    if (chain.getN()!=N)
+        return false;
+
+    for (unsigned int i=0; i<N; i++)
+    {
+        iKinLink &link=chain[i];
+        if (!match(link.getA(),A[i]) || !match(link.getD(),D[i]) ||
+            !match(link.getAlpha(),alpha[i]) || !match(link.getOffset(),offset[i]))
+            return false;
+    }
+
+    Matrix H0=chain.getH0();
+    Matrix HN=chain.getHN();
+    for (int r=0; r<4; r++)
+    {
+        for (int c=0; c<4; c++)
+        {
+            if (!match(H0(r,c),compiledKinematics::H0[4*r+c]) ||
+                !match(HN(r,c),compiledKinematics::HN[4*r+c]))
+                return false;
+        }
+    }
+
+    valid=true;
+    return valid;
+}
+
+/**********************************************************/
+bool CompiledChain::solve(iKinChain &chain, const Vector &xd, const bool orientation, Vector &q)
+{
+    using namespace compiledKinematics;
+
+    if (!valid || (xd.length()<(orientation?7:3)))
+        return false;
+
+    active.clear();
+    for (unsigned int i=0; i<N; i++)
+    {
+        iKinLink &link=chain[i];
+        this->q[i]=link.getAng();
+        lo[i]=link.getMin();
+        hi[i]=link.getMax();
+        if (!link.isBlocked())
+            active.push_back(i);
+    }
+
+    // the target rotation
+    double Rd[9];
+    if (orientation)
+    {
+        double kx=xd[3], ky=xd[4], kz=xd[5];
+        double c=cos(xd[6]), s=sin(xd[6]), v=1.0-c;
+        Rd[0]=c+kx*kx*v;    Rd[1]=kx*ky*v-kz*s; Rd[2]=kx*kz*v+ky*s;
+        Rd[3]=ky*kx*v+kz*s; Rd[4]=c+ky*ky*v;    Rd[5]=ky*kz*v-kx*s;
+        Rd[6]=kz*kx*v-ky*s; Rd[7]=kz*ky*v+kx*s; Rd[8]=c+kz*kz*v;
+    }
+
+    size_t m=orientation?6:3;
+    size_t n=active.size();
+
+    for (int iter=0; iter<=maxIter; iter++)
+    {
+        jacobian(this->q,J,H);
+
+        // the orientation error is half the sum of the cross
+        // products of the columns of the rotations
+        double e[6]={xd[0]-H[3], xd[1]-H[7], xd[2]-H[11], 0.0, 0.0, 0.0};
+        if (orientation)
+        {
+            for (int k=0; k<3; k++)
+            {
+                e[3]+=0.5*(H[4+k]*Rd[6+k]-H[8+k]*Rd[3+k]);
+                e[4]+=0.5*(H[8+k]*Rd[k]-H[k]*Rd[6+k]);
+                e[5]+=0.5*(H[k]*Rd[3+k]-H[4+k]*Rd[k]);
+            }
+        }
+
+        double norm=0.0;
+        for (size_t r=0; r<m; r++)
+            norm+=e[r]*e[r];
+
+        if (sqrt(norm)<tol)
+        {
+            q.resize(n);
+            for (size_t k=0; k<n; k++)
+                q[k]=this->q[active[k]];
+            return true;
+        }
+        else if (iter==maxIter)
+            break;
+
+        // M=J*J'+lambda^2*I over the active joints
+        double M[6][6]={{0.0}};
+        for (size_t r=0; r<m; r++)
+        {
+            for (size_t c=r; c<m; c++)
+            {
+                for (size_t k=0; k<n; k++)
+                    M[r][c]+=J[r*N+active[k]]*J[c*N+active[k]];
+                M[c][r]=M[r][c];
+            }
+            M[r][r]+=lambda*lambda;
+        }
+
+        // M is symmetric positive definite: plain elimination
+        for (size_t p=0; p<m; p++)
+        {
+            for (size_t r=p+1; r<m; r++)
+            {
+                double f=M[r][p]/M[p][p];
+                for (size_t c=p; c<m; c++)
+                    M[r][c]-=f*M[p][c];
+                e[r]-=f*e[p];
+            }
+        }
+
+        for (size_t p=m; p-->0;)
+        {
+            for (size_t c=p+1; c<m; c++)
+                e[p]-=M[p][c]*e[c];
+            e[p]/=M[p][p];
+        }
+
+        // dq=J'*inv(M)*e
+        for (size_t k=0; k<n; k++)
+        {
+            size_t j=active[k];
+            double dq=0.0;
+            for (size_t r=0; r<m; r++)
+                dq+=J[r*N+j]*e[r];
+
+            double qj=this->q[j]+dq;
+            this->q[j]=(qj<lo[j])?lo[j]:((qj>hi[j])?hi[j]:qj);
+        }
+    }
+
+    return false;
+}
+
+#endif
+
+/**********************************************************/
+bool MultiStart::serve()
+{
+    go.wait();
+    if (quit)
+        return false;
+
+    for (;;)
+    {
+        mutex.wait();
+        size_t i=next++;
+        mutex.post();
+
+        if (i>=starts.size())
+            break;
+
+        Start &s=starts[i];
+        Vector target=xd;
+        s.q=s.slv->solve(s.q0,target);
+        s.err=error(s.chain->EndEffPose(s.q),xd,orientation);
+    }
+
+    done.post();
+    return true;
+}
+
+/**********************************************************/
+void MultiStart::release()
+{
+    for (size_t i=0; i<starts.size(); i++)
+    {
+        delete starts[i].slv;
+        delete starts[i].chain;
+    }
+
+    starts.clear();
+}
+
+/**********************************************************/
+void MultiStart::dcm(const Vector &x, double R[3][3])
+{
+    double kx=x[3], ky=x[4], kz=x[5];
+    double c=cos(x[6]), s=sin(x[6]), v=1.0-c;
+
+    R[0][0]=c+kx*kx*v;    R[0][1]=kx*ky*v-kz*s; R[0][2]=kx*kz*v+ky*s;
+    R[1][0]=ky*kx*v+kz*s; R[1][1]=c+ky*ky*v;    R[1][2]=ky*kz*v-kx*s;
+    R[2][0]=kz*kx*v-ky*s; R[2][1]=kz*ky*v+kx*s; R[2][2]=c+kz*kz*v;
+}
+
+/**********************************************************/
+double MultiStart::error(const Vector &x, const Vector &xd, const bool orientation)
+{
+    double e=0.0;
+    for (size_t i=0; i<3; i++)
+        e+=(xd[i]-x[i])*(xd[i]-x[i]);
+
+    if (orientation && (x.length()>=7) && (xd.length()>=7))
+    {
+        double R[3][3],Rd[3][3];
+        dcm(x,R);
+        dcm(xd,Rd);
+        for (int r=0; r<3; r++)
+            for (int c=0; c<3; c++)
+                e+=(Rd[r][c]-R[r][c])*(Rd[r][c]-R[r][c]);
+    }
+
+    return sqrt(e);
+}
+
+/**********************************************************/
+void MultiStart::configure(Searchable &options)
+{
+    K=options.check("multi_start",Value(1)).asInt();
+    poolSize=options.check("multi_start_pool",Value(0)).asInt();
+    constrTol=options.check("constr_tol",Value(1e-6)).asDouble();
+    rng.seed((unsigned int)options.check("multi_start_seed",Value(0)).asInt());
+
+    if (poolSize<=0)
+        poolSize=std::max((int)thread::hardware_concurrency()-1,1);
+    poolSize=std::min(poolSize,std::max(K-1,1));
+
+    restPos.resize(0);
+    if (Bottle *rest=options.find("rest_pos").asList())
+        for (int i=0; i<rest->size(); i++)
+            restPos.push_back(IKINCTRL_DEG2RAD*rest->get(i).asDouble());
+
+    if (isEnabled() && pool.empty())
+    {
+        quit=false;
+        for (int i=0; i<poolSize; i++)
+        {
+            pool.push_back(new Worker(*this));
+            pool.back()->start();
+        }
+    }
+}
+
+/**********************************************************/
+void MultiStart::dispatch(iKinChain &chain, const string &sig, const unsigned int ctrlPose,
+                          const double tol, const int maxIter, const Vector &xd,
+                          const bool orientation)
+{
+    if (sig!=signature)
+    {
+        release();
+        starts.resize(K-1);
+        for (size_t i=0; i<starts.size(); i++)
+        {
+            starts[i].chain=new iKinChain(chain);
+            starts[i].slv=new iKinIpOptMin(*starts[i].chain,ctrlPose,tol,constrTol,maxIter);
+        }
+
+        signature=sig;
+    }
+
+    // the seeds: the resting posture first, then random samples
+    Matrix H0=chain.getH0();
+    Matrix HN=chain.getHN();
+    size_t dof=chain.getDOF();
+    for (size_t i=0; i<starts.size(); i++)
+    {
+        Start &s=starts[i];
+        s.slv->set_ctrlPose(ctrlPose);
+        s.slv->setTol(tol);
+        s.slv->setMaxIter(maxIter);
+
+        s.chain->setH0(H0);
+        s.chain->setHN(HN);
+        for (unsigned int l=0; l<chain.getN(); l++)
+            if (chain[l].isBlocked())
+                s.chain->setBlockingValue(l,chain[l].getAng());
+
+        s.q0.resize(dof);
+        for (unsigned int l=0, j=0; l<chain.getN(); l++)
+        {
+            if (chain[l].isBlocked())
+                continue;
+
+            double min=chain[l].getMin();
+            double max=chain[l].getMax();
+            double val;
+            if ((i==0) && (restPos.length()==chain.getN()))
+                val=std::max(min,std::min(max,restPos[l]));
+            else
+                val=uniform_real_distribution<double>(min,max)(rng);
+
+            s.q0[j++]=val;
+        }
+
+        s.chain->setAng(s.q0);
+    }
+
+    this->xd=xd;
+    this->orientation=orientation;
+
+    next=0;
+    for (size_t i=0; i<pool.size(); i++)
+        go.post();
+}
+
+/**********************************************************/
+bool MultiStart::collect(const Vector &qc, Vector &q, const double err, const double tol)
+{
+    for (size_t i=0; i<pool.size(); i++)
+        done.wait();
+
+    int best=-1;
+    double bestErr=err;
+    double bestDist=distance(q,qc);
+    bool feasible=(err<=tol);
+
+    for (size_t i=0; i<starts.size(); i++)
+    {
+        Start &s=starts[i];
+        if (s.q.length()!=q.length())
+            continue;
+
+        double dist=distance(s.q,qc);
+        bool better=(s.err<=tol)?(!feasible || (dist<bestDist)):
+                                 (!feasible && (s.err<bestErr));
+        if (better)
+        {
+            best=(int)i;
+            bestErr=s.err;
+            bestDist=dist;
+            feasible=(s.err<=tol);
+        }
+    }
+
+    solves++;
+    if (best>=0)
+    {
+        q=starts[best].q;
+        wins++;
+    }
+
+    return (best>=0);
+}
+
+/**********************************************************/
+double MultiStart::distance(const Vector &a, const Vector &b)
+{
+    double d=0.0;
+    for (size_t i=0; (i<a.length()) && (i<b.length()); i++)
+        d+=(a[i]-b[i])*(a[i]-b[i]);
+
+    return d;
+}
+
+/**********************************************************/
+void MultiStart::reset()
+{
+    wins=solves=0;
+}
+
+/**********************************************************/
+void MultiStart::toBottle(Bottle &b) const
+{
+    Bottle &l=b.addList();
+    l.addString("multi_start");
+    l.addInt(K);
+    l.addInt((int)pool.size());
+    l.addInt((int)solves);
+    l.addInt((int)wins);
+}
+
+/**********************************************************/
+MultiStart::~MultiStart()
+{
+    quit=true;
+    for (size_t i=0; i<pool.size(); i++)
+        go.post();
+
+    for (size_t i=0; i<pool.size(); i++)
+    {
+        pool[i]->stop();
+        delete pool[i];
+    }
+
+    release();
+}
+
+/**********************************************************/
+PartDescriptor *fakeRobotCartesianSolver::getPartDesc(Searchable &options)
+{
+    if (!options.check("CustomKinFile"))
+    {
+        cout<<"Error: \"CustomKinFile\" option is missing!"<<endl;
+        return NULL;
+    }
+
+    string robot=options.check("robot",Value("fake_robot")).asString().c_str();
+    string part="fake_part";
+
+    // here we declare everything is required to open up
+    // the device driver to access the fake robot
+    Property optPart;
+    optPart.put("device","fakeyClient");
+    optPart.put("remote",("/"+robot+"/"+part).c_str());
+    optPart.put("local",("/"+slvName+"/"+part).c_str());
+    optPart.put("part",part.c_str());
+    if (options.check("state_timeout"))
+        optPart.put("state_timeout",options.find("state_timeout").asDouble());
+    if (options.check("wire"))
+        optPart.put("wire",options.find("wire").asString().c_str());
+    if (options.check("carrier"))
+        optPart.put("carrier",options.find("carrier").asString().c_str());
+
+    // we grab info on the fake robot's kinematics
+    Property linksOptions;
+    linksOptions.fromConfigFile(options.find("CustomKinFile").asString().c_str());
+    iKinLimb *limb=new iKinLimb(linksOptions);
+    if (!limb->isValid())
+    {
+        cout<<"Error: invalid links parameters!"<<endl;
+        delete limb;
+        return NULL;
+    }
+
+    // planar chains are solved without the optimizer
+    if (fastPath && planar.configure(*limb->asChain()))
+        cout<<"Planar chain detected: the optimizer is the fallback"<<endl;
+#ifdef USE_COMPILED_KINEMATICS
+    // general chains rely on the code generated at build time
+    else if (fastPath && compiled.configure(*limb->asChain()))
+        cout<<"Compiled chain detected: the optimizer is the fallback"<<endl;
+#endif
+    else
+        cout<<"General chain: the optimizer is employed"<<endl;
+
+    // we fill in the descriptor fields
+    PartDescriptor *p=new PartDescriptor;
+    p->lmb=limb;                // a pointer to the iKinLimb
+    p->chn=limb->asChain();     // the associated iKinChain object
+    p->cns=NULL;                // any further (linear) constraints on the joints other than the bounds? This requires some more effort
+    p->prp.push_back(optPart);  // attach the options to open the device driver of the fake part
+    p->rvs.push_back(false);    // it may happen that the motor commands to be sent are in reversed order wrt the order of kinematics links (e.g. the iCub torso); if so put here "true"
+    p->num=1;                   // only one device driver for the whole limb (see below)
+
+    // whenever a limb is actuated resorting to more than one device
+    // (e.g. for iCub: torso+arm), the following applies:
+    // 
+    // p->prp.push_back(optDevice_1);
+    // p->prp.push_back(optDevice_2);
+    // p->rvs.push_back(true);
+    // p->rvs.push_back(false);
+    // p->num=2;
+
+    return p;
+}
+
+/**********************************************************/
+string fakeRobotCartesianSolver::getSignature()
+{
+    iKinChain &chain=*prt->chn;
+
+    // the values are printed at full precision, since the
+    // solutions cached under one signature are served as they are
+    ostringstream sig;
+    sig<<setprecision(17)<<slv->get_ctrlPose()<<" "<<slv->getTol();
+    for (unsigned int i=0; i<chain.getN(); i++)
+        sig<<" "<<chain[i].isBlocked()<<" "<<chain[i].getMin()<<" "<<chain[i].getMax();
+
+    // the rest posture and its weights drive the redundancy
+    for (size_t i=0; (i<w_3rdTask.length()) && (i<qd_3rdTask.length()); i++)
+        sig<<" "<<w_3rdTask[i]<<" "<<qd_3rdTask[i];
+
+    // the rigid transformations of the base and of the end-effector
+    Matrix H0=chain.getH0();
+    Matrix HN=chain.getHN();
+    for (int r=0; r<4; r++)
+        for (int c=0; c<4; c++)
+            sig<<" "<<H0(r,c)<<" "<<HN(r,c);
+
+    return sig.str();
+}
+
+/**********************************************************/
+bool fakeRobotCartesianSolver::isRestWeighted() const
+{
+    for (size_t i=0; i<w_3rdTask.length(); i++)
+        if (w_3rdTask[i]!=0.0)
+            return true;
+
+    return false;
+}
+
+/**********************************************************/
+Vector fakeRobotCartesianSolver::solve(Vector &xd)
+{
+    iKinChain &chain=*prt->chn;
+    int ctrlPose=slv->get_ctrlPose();
+    bool orientation=(ctrlPose!=IKINCTRL_POSE_XYZ);
+    string sig=getSignature();
+
+    Vector q;
+    bool hit;
+    if (cache.lookup(sig,xd,orientation,q,hit) && (q.length()==chain.getDOF()))
+    {
+        // the solver leaves the chain in the solved configuration
+        chain.setAng(q);
+        if (hit)
+            return q;
+    }
+
+    double t0=Time::now();
+    int method=PlanarChain::NONE;
+    bool fast=fastPath && !isRestWeighted() &&
+              ((ctrlPose==IKINCTRL_POSE_XYZ) || (ctrlPose==IKINCTRL_POSE_FULL));
+    if (fast)
+        method=planar.solve(chain,xd,orientation,q);
+#ifdef USE_COMPILED_KINEMATICS
+    if (fast && compiled.isValid() && compiled.solve(chain,xd,orientation,q))
+        method=PlanarChain::DLS;
+#endif
+
+    if (method!=PlanarChain::NONE)
+        chain.setAng(q);
+    else if (multiStart.isEnabled())
+    {
+        // the other starts run while the current one is solved
+        Vector qc=chain.getAng();
+        multiStart.dispatch(chain,sig,ctrlPose,slv->getTol(),slv->getMaxIter(),
+                            xd,orientation);
+
+        q=CartesianSolver::solve(xd);
+        double err=MultiStart::error(chain.EndEffPose(),xd,orientation);
+        if (multiStart.collect(qc,q,err,slv->getTol()))
+            chain.setAng(q);
+    }
+    else
+        q=CartesianSolver::solve(xd);
+
+    count[method]++;
+    elapsed[method]+=Time::now()-t0;
+
+    // only the solutions reaching the target are worth caching,
+    // since the hits are served without solving again
+    if (MultiStart::error(chain.EndEffPose(q),xd,orientation)<=slv->getTol())
+        cache.store(xd,orientation,q);
+
+    return q;
+}
+
+/**********************************************************/
+void fakeRobotCartesianSolver::methodsToBottle(Bottle &b)
+{
+    const char *names[]={"optimizer","analytic","dls"};
+    int order[]={PlanarChain::ANALYTIC,PlanarChain::DLS,PlanarChain::NONE};
+    for (int i=0; i<3; i++)
+    {
+        int k=order[i];
+        Bottle &l=b.addList();
+        l.addString(names[k]);
+        l.addInt((int)count[k]);
+        l.addDouble(count[k]>0?1e6*elapsed[k]/count[k]:0.0);
+    }
+
+    multiStart.toBottle(b);
+}
+
+/**********************************************************/
+bool fakeRobotCartesianSolver::respond(const Bottle &command, Bottle &reply)
+{
+    if (command.get(0).asVocab()==Vocab::encode("cache"))
+    {
+        int method=command.get(1).asVocab();
+        if (method==Vocab::encode("stat"))
+        {
+            reply.addVocab(Vocab::encode("ack"));
+            cache.toBottle(reply);
+        }
+        else if (method==Vocab::encode("rst"))
+        {
+            cache.reset();
+            reply.addVocab(Vocab::encode("ack"));
+        }
+        else if (method==Vocab::encode("clr"))
+        {
+            cache.clear();
+            reply.addVocab(Vocab::encode("ack"));
+        }
+        else
+            reply.addVocab(Vocab::encode("nack"));
+
+        return true;
+    }
+    else if (command.get(0).asVocab()==Vocab::encode("fast"))
+    {
+        int method=command.get(1).asVocab();
+        if (method==Vocab::encode("stat"))
+        {
+            reply.addVocab(Vocab::encode("ack"));
+            Bottle &c=reply.addList();
+            c.addString("chain");
+#ifdef USE_COMPILED_KINEMATICS
+            c.addString(planar.isValid()?"planar":(compiled.isValid()?"compiled":"general"));
+#else
+            c.addString(planar.isValid()?"planar":"general");
+#endif
+            methodsToBottle(reply);
+        }
+        else if (method==Vocab::encode("rst"))
+        {
+            for (int i=0; i<3; i++)
+            {
+                count[i]=0;
+                elapsed[i]=0.0;
+            }
+            multiStart.reset();
+            reply.addVocab(Vocab::encode("ack"));
+        }
+        else
+            reply.addVocab(Vocab::encode("nack"));
+
+        return true;
+    }
+
+    return CartesianSolver::respond(command,reply);
+}
+
+/**********************************************************/
+fakeRobotCartesianSolver::fakeRobotCartesianSolver(const string &name) : CartesianSolver(name),
+                                                                          fastPath(true)
+{
+    for (int i=0; i<3; i++)
+    {
+        count[i]=0;
+        elapsed[i]=0.0;
+    }
+}
+
+/**********************************************************/
+void fakeRobotCartesianSolver::configureExtras(Searchable &options)
+{
+    cache.configure(options);
+    multiStart.configure(options);
+
+    fastPath=(options.check("fast_path",Value("on")).asString()=="on");
+    planar.setParameters(options.check("fast_damping",Value(0.01)).asDouble(),
+                         options.check("fast_tol",Value(1e-6)).asDouble(),
+                         options.check("fast_max_iter",Value(100)).asInt());
+#ifdef USE_COMPILED_KINEMATICS
+    compiled.setParameters(options.check("fast_damping",Value(0.01)).asDouble(),
+                           options.check("fast_tol",Value(1e-6)).asDouble(),
+                           options.check("fast_max_iter",Value(100)).asInt());
+#endif
+}
+
+/**********************************************************/
+bool SolverModule::configure(ResourceFinder &rf)
+{                
+    if (!rf.check("name"))
+    {
+        cout<<"Error: \"name\" option is missing!"<<endl;
+        return false;
+    }
+
+    string solverName=rf.find("name").asString().c_str();
+    string pathToKin=rf.findFile("kinematics_file").c_str();
+
+    Property config;
+    config.fromConfigFile(rf.findFile("from").c_str());
+    config.put("CustomKinFile",pathToKin.c_str());
+    if (rf.check("carrier"))
+        config.put("carrier",rf.find("carrier").asString().c_str());
+
+    solver=new fakeRobotCartesianSolver(solverName);
+    solver->configureExtras(rf);
+    if (!solver->open(config))
+    {    
+        delete solver;
+        solver=NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/**********************************************************/
+bool SolverModule::interruptModule()
+{
+    if (solver!=NULL)
+        solver->interrupt();
+
+    return true;
+}
+
+/**********************************************************/
+bool SolverModule::close()
+{
+    delete solver;
+    solver=NULL;
+    return true;
+}
+
+/**********************************************************/
+double SolverModule::getPeriod()
+{
+    return 1.0;
+}
+
+/**********************************************************/
+bool SolverModule::updateModule()
+{
+    if (solver->isClosed() || solver->getTimeoutFlag())
+        return false;
+    else
+        return true;
+}
+
+
@@ -0,0 +1,511 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __SOLVERMODULE_H__
+#define __SOLVERMODULE_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <iCub/iKin/iKinSlv.h>
+
+#ifdef USE_COMPILED_KINEMATICS
+    #include <compiledKinematics.h>
+#endif
+
+namespace solverModule
+{
+
+/**
+ * This class stores the solutions found for the targets. The
+ * targets are quantized so that a target matching a stored one
+ * within the tolerances is served immediately (hit), whereas a
+ * target close enough to a stored one lets the solver start off
+ * from its solution (warm start). The positions are in [m] and
+ * the orientations are compared as rotation vectors in [rad].
+ *
+ * The solutions depend on the configuration of the chain too
+ * (pose control, DOF and joints bounds), which is summarized by
+ * a signature: whenever it changes, the cache is flushed.
+ */
+class SolutionCache
+{
+protected:
+    struct Entry
+    {
+        yarp::sig::Vector xd;
+        yarp::sig::Vector q;
+        unsigned int lastUse;
+    };
+
+    std::map<std::vector<long>,Entry> entries;
+    std::string signature;
+    yarp::os::Semaphore mutex;
+
+    bool enabled;
+    size_t capacity;
+    double posTol,angTol;
+    double warmPos,warmAng;
+    unsigned int clock;
+
+    unsigned int lookups,hits,warmStarts,evictions;
+
+    static yarp::sig::Vector rotation(const yarp::sig::Vector &xd);
+
+    std::vector<long> quantize(const yarp::sig::Vector &xd, const bool orientation) const;
+
+    static double distance(const yarp::sig::Vector &a, const yarp::sig::Vector &b, const size_t i0,
+                           const size_t len);
+
+public:
+    SolutionCache();
+
+    void configure(yarp::os::Searchable &options);
+
+    /**
+     * Look for the solution of the target.
+     * @param sig the signature of the chain configuration.
+     * @param xd the target.
+     * @param orientation true if the orientation is controlled.
+     * @param q the solution of the target (hit) or of the closest
+     *          target (warm start).
+     * @param hit true if the target matches a stored one.
+     * @return true if a solution has been found.
+     */
+    bool lookup(const std::string &sig, const yarp::sig::Vector &xd, const bool orientation,
+                yarp::sig::Vector &q, bool &hit);
+
+    /**
+     * Store the solution of the target, evicting the least
+     * recently used one when full.
+     */
+    void store(const yarp::sig::Vector &xd, const bool orientation, const yarp::sig::Vector &q);
+
+    void clear();
+
+    void reset();
+
+    /**
+     * Dump the counters as:
+     * (lookups n) (hits n) (warm n) (misses n) (evictions n)
+     * (size n) (hit_rate r)
+     */
+    void toBottle(yarp::os::Bottle &b);
+};
+
+/**
+ * This class solves the inverse kinematics of planar chains, that
+ * is chains whose joints axes are all parallel (alpha equal to 0 or
+ * pi), without resorting to the optimizer. When the DOF are as many
+ * as the task components (2 for the position, 3 for the full pose
+ * whose orientation reduces to the heading in the plane) the
+ * solution is given in closed form, choosing the elbow closest to
+ * the current configuration; redundant chains are solved through
+ * damped least-squares starting off from the current configuration.
+ *
+ * Only the targets lying in the plane can be attained, thus the
+ * others are left to the optimizer, as well as those that turn out
+ * unreachable or beyond the joints bounds. The base frame H0 is
+ * arbitrary, whereas the end-effector frame HN must keep its z-axis
+ * normal to the plane.
+ *
+ * The storage is allocated upon configuration; solving is not
+ * thread-safe but the super-class serializes the calls anyway.
+ */
+class PlanarChain
+{
+protected:
+    /**
+     * The frame in the plane: position, heading of the x-axis and
+     * sign of the z-axis wrt the base frame.
+     */
+    struct State
+    {
+        double x,y,z,h,s;
+        State(const double s=1.0) : x(0.0), y(0.0), z(0.0), h(0.0), s(s) { }
+    };
+
+    bool valid;
+    size_t N;
+    std::vector<double> A,D,offset;
+    std::vector<bool> flip;
+    yarp::sig::Matrix H0;
+    double toolX,toolY,toolZ,toolH,toolS;
+    double height,sign;
+
+    double lambda,tol;
+    int maxIter;
+
+    std::vector<double> theta,lo,hi;
+    std::vector<double> ox,oy,os,jac;
+    std::vector<size_t> active;
+
+    void advance(State &st, const size_t i, const double th) const;
+
+    void tool(State &st) const;
+
+    State forward() const;
+
+    static double wrap(const double a);
+
+    /**
+     * Shift the angle by turns so as to get as close as possible to
+     * the reference within the bounds.
+     */
+    static bool fit(double &th, const double lo, const double hi, const double ref);
+
+    bool analytic(const double x, const double y, const double h, const bool orientation);
+
+    bool dls(const double x, const double y, const double h, const bool orientation);
+
+public:
+    /**
+     * The methods employed to solve.
+     */
+    enum { NONE=0, ANALYTIC=1, DLS=2 };
+
+    /**********************************************************/
+    PlanarChain() : valid(false), N(0), toolX(0.0), toolY(0.0), toolZ(0.0),
+                    toolH(0.0), toolS(1.0), height(0.0), sign(1.0),
+                    lambda(0.01), tol(1e-6), maxIter(100) { }
+
+    void setParameters(const double lambda, const double tol, const int maxIter);
+
+    /**
+     * Detect whether the chain is planar and retrieve its
+     * structure; the model is then checked against the forward
+     * kinematics of the chain.
+     * @param chain the chain.
+     * @return true iff the chain is planar.
+     */
+    bool configure(iCub::iKin::iKinChain &chain);
+
+    /**********************************************************/
+    bool isValid() const { return valid; }
+
+    /**
+     * Solve for the target starting off from the current
+     * configuration of the chain, which is left untouched.
+     * @param chain the chain.
+     * @param xd the target as position and axis-angle orientation.
+     * @param orientation true if the orientation is controlled.
+     * @param q the solution.
+     * @return the method employed or NONE if the target is to be
+     *         left to the optimizer.
+     */
+    int solve(iCub::iKin::iKinChain &chain, const yarp::sig::Vector &xd, const bool orientation,
+              yarp::sig::Vector &q);
+};
+
+#ifdef USE_COMPILED_KINEMATICS
+/**
+ * This class solves the inverse kinematics of general chains by
+ * damped least-squares, starting off from the current configuration
+ * and relying on the forward kinematics and the Jacobian generated
+ * by the kinCompiler at build time (see compiledKinematics.h). It
+ * applies only to the chain the code has been generated from; the
+ * targets that are not attained within the iterations are left to
+ * the optimizer.
+ *
+ * The storage is allocated upon configuration; solving is not
+ * thread-safe but the super-class serializes the calls anyway.
+ */
+class CompiledChain
+{
+protected:
+    bool valid;
+    double lambda,tol;
+    int maxIter;
+
+    double q[compiledKinematics::N];
+    double lo[compiledKinematics::N];
+    double hi[compiledKinematics::N];
+    double J[6*compiledKinematics::N];
+    double H[16];
+    std::vector<size_t> active;
+
+    static bool match(const double a, const double b);
+
+public:
+    CompiledChain();
+
+    void setParameters(const double lambda, const double tol, const int maxIter);
+
+    /**
+     * Check that the chain is the one the code has been generated
+     * from.
+     * @param chain the chain.
+     * @return true iff the chain matches.
+     */
+    bool configure(iCub::iKin::iKinChain &chain);
+
+    /**********************************************************/
+    bool isValid() const { return valid; }
+
+    /**
+     * Solve for the target starting off from the current
+     * configuration of the chain, which is left untouched.
+     * @param chain the chain.
+     * @param xd the target as position and axis-angle orientation.
+     * @param orientation true if the orientation is controlled.
+     * @param q the solution.
+     * @return true iff the target has been attained.
+     */
+    bool solve(iCub::iKin::iKinChain &chain, const yarp::sig::Vector &xd, const bool orientation,
+               yarp::sig::Vector &q);
+};
+#endif
+
+/**
+ * This class solves the same target starting off from several seeds
+ * at once: the current configuration is solved by the caller as
+ * usual, whereas the resting posture and random samples within the
+ * joints bounds are dispatched to a pool of threads, each start
+ * owning its copy of the chain along with its own optimizer. The
+ * best feasible solution is then retained, that is the one closest
+ * to the current configuration among those whose task error is
+ * within the tolerance, or else the one with the least error.
+ *
+ * Note that running IPOPT from many threads requires a thread-safe
+ * linear solver (e.g. MA27/MA57).
+ */
+class MultiStart
+{
+protected:
+    struct Start
+    {
+        iCub::iKin::iKinChain    *chain;
+        iCub::iKin::iKinIpOptMin *slv;
+        yarp::sig::Vector        q0;
+        yarp::sig::Vector        q;
+        double        err;
+    };
+
+    /**
+     * The worker serves the starts until the pool is closed.
+     */
+    class Worker : public yarp::os::Thread
+    {
+        MultiStart &owner;
+
+    public:
+        /**********************************************************/
+        Worker(MultiStart &owner) : owner(owner) { }
+
+        /**********************************************************/
+        void run()
+        {
+            while (owner.serve());
+        }
+    };
+
+    std::vector<Start> starts;
+    std::vector<Worker*> pool;
+    yarp::os::Semaphore go,done,mutex;
+    size_t next;
+    bool quit;
+
+    int K,poolSize;
+    double constrTol;
+    yarp::sig::Vector restPos;
+    std::mt19937 rng;
+    std::string signature;
+
+    yarp::sig::Vector xd;
+    bool orientation;
+    unsigned int wins,solves;
+
+    bool serve();
+
+    void release();
+
+    static void dcm(const yarp::sig::Vector &x, double R[3][3]);
+
+public:
+    /**
+     * The task error: the norm of the position error stacked
+     * with, if controlled, the rotations difference (Frobenius
+     * norm), which is the metric the tolerance of the optimizer
+     * is compared with throughout, from the selection of the
+     * starts to the admission in the cache.
+     */
+    static double error(const yarp::sig::Vector &x, const yarp::sig::Vector &xd, const bool orientation);
+
+    /**********************************************************/
+    MultiStart() : go(0), done(0), mutex(1), next(0), quit(false), K(1),
+                   poolSize(1), constrTol(1e-6), orientation(false),
+                   wins(0), solves(0) { }
+
+    /**
+     * Configure the number of starts, the pool size, the random
+     * seed and the resting posture in [deg]; the pool is started
+     * as well.
+     */
+    void configure(yarp::os::Searchable &options);
+
+    /**********************************************************/
+    bool isEnabled() const { return (K>1); }
+
+    /**
+     * Solve the starts other than the current configuration on
+     * the pool: to be followed by collect().
+     * @param chain the chain in the current configuration.
+     * @param sig the signature of the chain configuration: the
+     *            copies are rebuilt whenever it changes, whereas
+     *            the angles of the blocked joints and the rigid
+     *            transformations H0 and HN are copied every time.
+     * @param ctrlPose, tol, maxIter the optimizer settings.
+     * @param xd the target.
+     * @param orientation true if the orientation is controlled.
+     */
+    void dispatch(iCub::iKin::iKinChain &chain, const std::string &sig, const unsigned int ctrlPose,
+                  const double tol, const int maxIter, const yarp::sig::Vector &xd,
+                  const bool orientation);
+
+    /**
+     * Wait for the starts and select the best solution.
+     * @param qc the current configuration.
+     * @param q the solution from the current configuration, which
+     *          is replaced by the best one.
+     * @param err its task error (see error()).
+     * @param tol the tolerance.
+     * @return true if another start has won.
+     */
+    bool collect(const yarp::sig::Vector &qc, yarp::sig::Vector &q, const double err, const double tol);
+
+    static double distance(const yarp::sig::Vector &a, const yarp::sig::Vector &b);
+
+    void reset();
+
+    /**
+     * Dump the counters as: (multi_start K pool solves wins)
+     */
+    void toBottle(yarp::os::Bottle &b) const;
+
+    ~MultiStart();
+};
+
+/**
+ * This class inherits from the CartesianSolver super-class
+ * implementing the solver
+ */
+class fakeRobotCartesianSolver : public iCub::iKin::CartesianSolver
+{
+protected:
+    SolutionCache cache;
+    PlanarChain planar;
+#ifdef USE_COMPILED_KINEMATICS
+    CompiledChain compiled;
+#endif
+    MultiStart multiStart;
+    bool fastPath;
+
+    // solutions count and overall time per method
+    unsigned int count[3];
+    double elapsed[3];
+
+    /**
+     * This particular method serves to describe all the device
+     * drivers used by the solver to access the robot, along with
+     * the kinematic structure of the links.
+     * 
+     * @param options The parameters required by the super-class to 
+     *                get configured.
+     * @return A pointer to the descriptor or NULL if something wrong happens.
+     */
+    iCub::iKin::PartDescriptor *getPartDesc(yarp::os::Searchable &options);
+
+    /**
+     * Summarize the configuration the solutions depend on: the
+     * controlled pose, the tolerance, the joints blocked and
+     * their bounds, the rest posture with its weights and the
+     * frames H0 and HN.
+     */
+    std::string getSignature();
+
+    /**
+     * Tell whether the resting posture is currently weighted, as
+     * set either in the configuration or later through the rpc;
+     * the super-class keeps the weights of the posture task.
+     */
+    bool isRestWeighted() const;
+
+    /**
+     * The solutions are looked up in the cache first: hits are
+     * served straightaway, whereas near-hits let the solver start
+     * off from the cached solution rather than from the current
+     * configuration. Planar chains are then solved in closed form
+     * or by damped least-squares, as well as the chains matching
+     * the compiled kinematics, the optimizer being the fallback.
+     */
+    yarp::sig::Vector solve(yarp::sig::Vector &xd);
+
+    /**
+     * Dump the solutions count and the mean time in [us] per
+     * method as: (analytic n t) (dls n t) (optimizer n t),
+     * followed by the multi-start counters.
+     */
+    void methodsToBottle(yarp::os::Bottle &b);
+
+    /**
+     * Serve the requests concerning the cache on the rpc port:
+     * [cache] [stat], [cache] [rst] and [cache] [clr], as well as
+     * those concerning the solving methods: [fast] [stat] and
+     * [fast] [rst].
+     */
+    bool respond(const yarp::os::Bottle &command, yarp::os::Bottle &reply);
+
+public:
+    fakeRobotCartesianSolver(const std::string &name);
+
+    /**
+     * Configure the cache, the multi-start and the fast path for
+     * planar chains, which is bypassed whenever the resting
+     * posture is weighted since only the optimizer accounts for it
+     * (see solve()).
+     */
+    void configureExtras(yarp::os::Searchable &options);
+};
+
+class SolverModule: public yarp::os::RFModule
+{
+protected:
+    fakeRobotCartesianSolver *solver;
+
+public:
+    /**********************************************************/
+    SolverModule() : solver(NULL) { }
+
+    bool configure(yarp::os::ResourceFinder &rf);
+
+    bool interruptModule();
+
+    bool close();
+
+    double getPeriod();
+
+    bool updateModule();
+};
+
+}
+
+#endif
+
@@ -15,6 +15,15 @@
  * -) /ctrl/v:o    output the velocity profiles that steer the joints to the final configuration [deg/s] (to be connected to the robot)
  * -) /ctrl/x:o    output the current end-effector position in axis-angle format
  *
+ * The vectors owned by the threads are allocated once at start-up
+ * and then filled in place, whereas the calls to the libraries
+ * (e.g. the solver, the controller and the ports writes) may still
+ * allocate on their own. Enabling the CMake option COUNT_ALLOCATIONS,
+ * each thread periodically reports the heap allocations performed
+ * per iteration, libraries included, and the module quits with an
+ * error as soon as the code of the tutorial itself allocates once
+ * past the start-up iterations.
+ *
  *
  * \author Ugo Pattacini
  * 
@@ -23,6 +32,8 @@
 
 #include <string>
 #include <cstdio>
+#include <cstdlib>
+#include <new>
 
 #include <yarp/os/Network.h>
 #include <yarp/os/Semaphore.h>
@@ -45,6 +56,136 @@ using namespace iCub::ctrl;
 using namespace iCub::iKin;
 
 
+#ifdef COUNT_ALLOCATIONS
+#include <atomic>
+
+// The global operator new is replaced in order
+// to count the heap allocations of each thread
+/*****************************************************************/
+static thread_local unsigned long allocations=0;
+
+/*****************************************************************/
+void *operator new(size_t size)
+{
+    allocations++;
+    if (void *p=malloc(size>0?size:1))
+        return p;
+    else
+        throw bad_alloc();
+}
+
+/*****************************************************************/
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+#endif
+
+
+// This class reports the heap allocations
+// performed per iteration by the thread that
+// owns it and checks that those performed
+// outside the library calls (enclosed within
+// pause() and resume()) are none once past the
+// start-up iterations (no-op without
+// COUNT_ALLOCATIONS)
+/*****************************************************************/
+class allocProbe
+{
+protected:
+    const char    *name;
+    unsigned long  ticks;
+    unsigned long  count;
+    unsigned long  before;
+    unsigned long  pausedAt;
+    unsigned long  excluded;
+    unsigned long  iterations;
+
+#ifdef COUNT_ALLOCATIONS
+    static std::atomic<bool> failed;
+#endif
+
+public:
+    /*****************************************************************/
+    allocProbe(const char *_name) : name(_name), ticks(0), count(0), before(0),
+                                    pausedAt(0), excluded(0), iterations(0) { }
+
+    /*****************************************************************/
+    void begin()
+    {
+    #ifdef COUNT_ALLOCATIONS
+        before=allocations;
+        excluded=0;
+    #endif
+    }
+
+    /*****************************************************************/
+    void pause()
+    {
+    #ifdef COUNT_ALLOCATIONS
+        pausedAt=allocations;
+    #endif
+    }
+
+    /*****************************************************************/
+    void resume()
+    {
+    #ifdef COUNT_ALLOCATIONS
+        excluded+=allocations-pausedAt;
+    #endif
+    }
+
+    /*****************************************************************/
+    void end()
+    {
+    #ifdef COUNT_ALLOCATIONS
+        unsigned long total=allocations-before;
+        unsigned long own=total-excluded;
+        if ((++iterations>100) && (own>0))
+        {
+            fprintf(stdout,"Error: %s performed %lu heap allocations outside the library calls\n",
+                    name,own);
+            failed=true;
+        }
+
+        count+=total;
+        if (++ticks>=1000)
+        {
+            fprintf(stdout,"%s: %g heap allocations per iteration\n",name,(double)count/ticks);
+            ticks=count=0;
+        }
+    #endif
+    }
+
+    /*****************************************************************/
+    static bool hasFailed()
+    {
+    #ifdef COUNT_ALLOCATIONS
+        return failed;
+    #else
+        return false;
+    #endif
+    }
+};
+
+#ifdef COUNT_ALLOCATIONS
+std::atomic<bool> allocProbe::failed(false);
+#endif
+
+
+// Copy a vector scaling its elements, reallocating
+// the destination only when the sizes differ
+/*****************************************************************/
+void copyVector(const Vector &src, Vector &dst, const double scale=1.0)
+{
+    if (dst.length()!=src.length())
+        dst.resize(src.length());
+
+    for (size_t i=0; i<dst.length(); i++)
+        dst[i]=scale*src[i];
+}
+
+
 // This inherited class handles the incoming
 // target limb pose (xyz + axis/angle) and
 // the joints feedback
@@ -71,20 +212,18 @@ protected:
 
 public:
     /*****************************************************************/
-    Vector get_vect()
+    void get_vect(Vector &_vect, const double scale=1.0)
     {
         mutex.wait();
-        Vector _vect=vect;
+        copyVector(vect,_vect,scale);
         mutex.post();
-
-        return _vect;
     }
 
     /*****************************************************************/
     void set_vect(const Vector &_vect)
     {
         mutex.wait();
-        vect=_vect;
+        copyVector(_vect,vect);
         mutex.post();
     }
 };
@@ -106,8 +245,8 @@ public:
     void setDesired(const Vector &_xd, const Vector &_qd)
     {
         mutex.wait();
-        xd=_xd;
-        qd=_qd;
+        copyVector(_xd,xd);
+        copyVector(_qd,qd);
         mutex.post();
     }
 
@@ -115,8 +254,8 @@ public:
     void getDesired(Vector &_xd, Vector &_qd)
     {
         mutex.wait();
-        _xd=xd;
-        _qd=qd;
+        copyVector(xd,_xd);
+        copyVector(qd,_qd);
         mutex.post();
     }
 };
@@ -141,10 +280,21 @@ protected:
 
     Vector xd_old;
 
+    // workspace
+    Vector xd;
+    Vector q;
+    Vector q0;
+    Vector w_3rd;
+    Vector dummyVect;
+    Vector qdhat;
+    Vector xdhat;
+    Vector qdhat_deg;
+    allocProbe probe;
+
 public:
     /*****************************************************************/
     Solver(ResourceFinder &_rf, inPort *_port_q, exchangeData *_commData, unsigned int period) :
-           RateThread(period), rf(_rf), port_q(_port_q), commData(_commData)
+           RateThread(period), rf(_rf), port_q(_port_q), commData(_commData), probe("Solver")
     {
         limb=NULL;
         chain=NULL;
@@ -198,6 +348,17 @@ public:
 
         port_qd.open(("/"+name+"/qd:o").c_str());        
 
+        // allocate the workspace once for all; the minimization
+        // is also carried out against the current joints position
+        xd=xd_old;
+        q.resize(chain->getDOF(),0.0);
+        q0.resize(chain->getDOF(),0.0);
+        w_3rd.resize(chain->getDOF(),1.0);
+        dummyVect.resize(1,0.0);
+        qdhat.resize(chain->getDOF(),0.0);
+        xdhat.resize(xd.length(),0.0);
+        qdhat_deg.resize(chain->getDOF(),0.0);
+
         return true;
     }
 
@@ -213,36 +374,45 @@ public:
     /*****************************************************************/
     virtual void run()
     {
+        probe.begin();
+
         // get the target pose
-        Vector xd=port_xd.get_vect();
+        port_xd.get_vect(xd);
 
         // if new target is received
         if (!(xd==xd_old))
         {
             // get the feedback and update the chain
-            chain->setAng(CTRL_DEG2RAD*port_q->get_vect());
+            port_q->get_vect(q,CTRL_DEG2RAD);
+
+            probe.pause();
+            chain->setAng(q);
 
-            // minimize also against the current joints position
-            Vector q0=chain->getAng();
-            Vector w_3rd(chain->getDOF(),1.0);
+            // retrieve the joints position within the bounds
+            for (unsigned int i=0; i<chain->getDOF(); i++)
+                q0[i]=chain->getAng(i);
 
             // call the solver and start the convergence from the current point
-            Vector dummyVect(1);
-            Vector qdhat=slv->solve(q0,xd,0.0,dummyVect,dummyVect,0.01,q0,w_3rd);
+            qdhat=slv->solve(q0,xd,0.0,dummyVect,dummyVect,0.01,q0,w_3rd);
 
             // qdhat is an estimation of the real qd, so that xdhat is the actual achieved pose
-            Vector xdhat=chain->EndEffPose(qdhat);
+            xdhat=chain->EndEffPose(qdhat);
+            probe.resume();
 
             // update the exchange structure straightaway
             commData->setDesired(xdhat,qdhat);
 
             // send qdhat over yarp
-            Vector qdhat_deg=CTRL_RAD2DEG*qdhat;
+            copyVector(qdhat,qdhat_deg,CTRL_RAD2DEG);
+            probe.pause();
             port_qd.write(qdhat_deg);
+            probe.resume();
 
             // latch the current target
-            xd_old=xd;
+            copyVector(xd,xd_old);
         }
+
+        probe.end();
     }
 
     /*****************************************************************/
@@ -275,10 +445,18 @@ protected:
     Port                 port_v;
     Port                 port_x;
 
+    // workspace
+    Vector               xd;
+    Vector               qd;
+    Vector               q;
+    Vector               qdot_deg;
+    Vector               x;
+    allocProbe           probe;
+
 public:
     /*****************************************************************/
     Controller(ResourceFinder &_rf, inPort *_port_q, exchangeData *_commData, unsigned int period) :
-               RateThread(period), rf(_rf), port_q(_port_q), commData(_commData)
+               RateThread(period), rf(_rf), port_q(_port_q), commData(_commData), probe("Controller")
     {
         limb=NULL;
         chain=NULL;
@@ -319,6 +497,14 @@ public:
         port_v.open(("/"+name+"/v:o").c_str());
         port_x.open(("/"+name+"/x:o").c_str());
 
+        // allocate the workspace once for all
+        // (the targets come always in axis-angle format)
+        xd.resize(7,0.0);
+        qd.resize(chain->getDOF(),0.0);
+        q.resize(chain->getDOF(),0.0);
+        qdot_deg.resize(chain->getDOF(),0.0);
+        x.resize(7,0.0);
+
         return true;
     }
 
@@ -334,22 +520,31 @@ public:
     /*****************************************************************/
     virtual void run()
     {
-        Vector xd,qd;
+        probe.begin();
 
         // get the current target pose (both xd and qd are required)
         commData->getDesired(xd,qd);
 
         // get the feedback
-        ctrl->set_q(CTRL_DEG2RAD*port_q->get_vect());
+        port_q->get_vect(q,CTRL_DEG2RAD);
 
         // control the limb and dump all available information at rate of 1/100th
+        probe.pause();
+        ctrl->set_q(q);
         ctrl->iterate(xd,qd,0x0064ffff);
+        const Vector &qdot=ctrl->get_qdot();
+        const Vector &xc=ctrl->get_x();
+        probe.resume();
 
         // send v and x through YARP ports
-        Vector qdot_deg=CTRL_RAD2DEG*ctrl->get_qdot();
-        Vector x=ctrl->get_x();
+        copyVector(qdot,qdot_deg,CTRL_RAD2DEG);
+        copyVector(xc,x);
+        probe.pause();
         port_v.write(qdot_deg);
         port_x.write(x);
+        probe.resume();
+
+        probe.end();
     }
 
     /*****************************************************************/
@@ -437,7 +632,8 @@ public:
     /*****************************************************************/
     virtual bool updateModule()
     {
-        return true;
+        // quit as soon as the tutorial code allocates
+        return !allocProbe::hasFailed();
     }
 };
 
@@ -467,7 +663,9 @@ int main(int argc, char *argv[])
         return 1;
 
     CtrlModule mod;
-    return mod.runModule(rf);
+    int ret=mod.runModule(rf);
+
+    return (allocProbe::hasFailed()?1:ret);
 }
 
 